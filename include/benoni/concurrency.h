@@ -0,0 +1,115 @@
+#ifndef BENONI_CONCURRENCY_H_
+#define BENONI_CONCURRENCY_H_
+
+#include <chrono>  // std::chrono::milliseconds
+#include <cstddef> // std::size_t
+
+namespace benoni {
+
+class AdaptiveConcurrencyOptionsBuilder;
+
+class AdaptiveConcurrencyOptions {
+public:
+  std::size_t initial_limit() const { return initial_limit_; }
+  std::size_t min_limit() const { return min_limit_; }
+  std::size_t max_limit() const { return max_limit_; }
+  double backoff_ratio() const { return backoff_ratio_; }
+  double latency_tolerance() const { return latency_tolerance_; }
+  std::size_t max_queue() const { return max_queue_; }
+  std::chrono::milliseconds max_queue_wait() const { return max_queue_wait_; }
+
+private:
+  AdaptiveConcurrencyOptions(std::size_t initial_limit, std::size_t min_limit,
+                             std::size_t max_limit, double backoff_ratio,
+                             double latency_tolerance, std::size_t max_queue,
+                             std::chrono::milliseconds max_queue_wait)
+      : initial_limit_{initial_limit}, min_limit_{min_limit},
+        max_limit_{max_limit}, backoff_ratio_{backoff_ratio},
+        latency_tolerance_{latency_tolerance}, max_queue_{max_queue},
+        max_queue_wait_{max_queue_wait} {}
+
+  friend AdaptiveConcurrencyOptionsBuilder;
+
+  std::size_t initial_limit_;
+  std::size_t min_limit_;
+  std::size_t max_limit_;
+  double backoff_ratio_;
+  double latency_tolerance_;
+  std::size_t max_queue_;
+  std::chrono::milliseconds max_queue_wait_;
+};
+
+class AdaptiveConcurrencyOptionsBuilder {
+public:
+  // Number of requests a host may have in flight before any latency has been
+  // measured.
+  AdaptiveConcurrencyOptionsBuilder &set_initial_limit(std::size_t limit) {
+    initial_limit_ = limit;
+    return *this;
+  }
+
+  // Bounds of the number of requests a host may have in flight.
+  AdaptiveConcurrencyOptionsBuilder &set_limits(std::size_t min_limit,
+                                                std::size_t max_limit) {
+    min_limit_ = min_limit;
+    max_limit_ = max_limit;
+    return *this;
+  }
+
+  // Factor the limit is multiplied by when a request fails or is too slow.
+  AdaptiveConcurrencyOptionsBuilder &set_backoff_ratio(double ratio) {
+    backoff_ratio_ = ratio;
+    return *this;
+  }
+
+  // A request is too slow once its round-trip time exceeds this multiple of
+  // the lowest round-trip time recently observed for its host.
+  AdaptiveConcurrencyOptionsBuilder &set_latency_tolerance(double tolerance) {
+    latency_tolerance_ = tolerance;
+    return *this;
+  }
+
+  // Number of requests that may wait for a host that is at its limit. Further
+  // requests are rejected right away.
+  AdaptiveConcurrencyOptionsBuilder &set_max_queue(std::size_t max_queue) {
+    max_queue_ = max_queue;
+    return *this;
+  }
+
+  // How long a request may wait in the queue before it is rejected.
+  AdaptiveConcurrencyOptionsBuilder &
+  set_max_queue_wait(std::chrono::milliseconds max_queue_wait) {
+    max_queue_wait_ = max_queue_wait;
+    return *this;
+  }
+
+  AdaptiveConcurrencyOptions build() {
+    return AdaptiveConcurrencyOptions(initial_limit_, min_limit_, max_limit_,
+                                      backoff_ratio_, latency_tolerance_,
+                                      max_queue_, max_queue_wait_);
+  }
+
+private:
+  std::size_t initial_limit_ = 20;
+  std::size_t min_limit_ = 1;
+  std::size_t max_limit_ = 1000;
+  double backoff_ratio_ = 0.9;
+  double latency_tolerance_ = 2.0;
+  std::size_t max_queue_ = 100;
+  std::chrono::milliseconds max_queue_wait_{100};
+};
+
+// Limits the number of requests sent with request() that each host may have in
+// flight. The limit of a host grows by about one request per round trip while
+// the host uses at least half of it and its latency stays close to the lowest
+// one observed, and shrinks by the backoff ratio when a request fails, gets a
+// 429 or 5xx status, or is too slow.
+auto enable_adaptive_concurrency(AdaptiveConcurrencyOptions options) -> void;
+
+// Stops limiting new requests. Requests that are already queued are still
+// sent.
+auto disable_adaptive_concurrency() -> void;
+
+} // namespace benoni
+
+#endif
@@ -1,11 +1,15 @@
 #ifndef BENONI_HTTP_H_
 #define BENONI_HTTP_H_
 
-#include <functional> // std::function
-#include <map>        // std::multimap
-#include <optional>   // std::optional
-#include <string>     // std::string
-#include <variant>    // std::variant
+#include <cstddef>         // std::size_t
+#include <cstdint>         // uint16_t, uint64_t
+#include <functional>      // std::function
+#include <map>             // std::multimap, std::pmr::multimap
+#include <memory>          // std::unique_ptr
+#include <memory_resource> // std::pmr::memory_resource
+#include <optional>        // std::optional
+#include <string>          // std::string, std::pmr::string
+#include <variant>         // std::variant
 
 namespace benoni {
 
@@ -21,6 +25,77 @@ enum class Method {
 #undef V
 };
 
+enum class TlsVersion {
+  TLS_1_0,
+  TLS_1_1,
+  TLS_1_2,
+  TLS_1_3,
+};
+
+class TlsOptionsBuilder;
+
+class TlsOptions {
+public:
+  const std::string &ca_file() const { return ca_file_; }
+  const std::string &certificate_file() const { return certificate_file_; }
+  const std::string &private_key_file() const { return private_key_file_; }
+  const std::optional<TlsVersion> &minimum_version() const {
+    return minimum_version_;
+  }
+
+private:
+  TlsOptions(std::string ca_file, std::string certificate_file,
+             std::string private_key_file,
+             std::optional<TlsVersion> minimum_version)
+      : ca_file_{std::move(ca_file)},
+        certificate_file_{std::move(certificate_file)},
+        private_key_file_{std::move(private_key_file)},
+        minimum_version_{std::move(minimum_version)} {}
+
+  friend TlsOptionsBuilder;
+
+  std::string ca_file_;
+  std::string certificate_file_;
+  std::string private_key_file_;
+  std::optional<TlsVersion> minimum_version_;
+};
+
+class TlsOptionsBuilder {
+public:
+  // PEM file with the certificate authorities that are trusted instead of the
+  // system ones.
+  TlsOptionsBuilder &set_ca_file(std::string ca_file) {
+    ca_file_ = std::move(ca_file);
+    return *this;
+  }
+
+  // PEM files with the client certificate and its private key, presented to
+  // servers that request one.
+  TlsOptionsBuilder &set_client_certificate(std::string certificate_file,
+                                            std::string private_key_file) {
+    certificate_file_ = std::move(certificate_file);
+    private_key_file_ = std::move(private_key_file);
+    return *this;
+  }
+
+  TlsOptionsBuilder &set_minimum_version(TlsVersion minimum_version) {
+    minimum_version_ = minimum_version;
+    return *this;
+  }
+
+  TlsOptions build() {
+    return TlsOptions(std::move(ca_file_), std::move(certificate_file_),
+                      std::move(private_key_file_),
+                      std::move(minimum_version_));
+  }
+
+private:
+  std::string ca_file_;
+  std::string certificate_file_;
+  std::string private_key_file_;
+  std::optional<TlsVersion> minimum_version_;
+};
+
 class RequestOptionsBuilder;
 
 class RequestOptions {
@@ -31,13 +106,25 @@ public:
     return headers_;
   }
   const std::optional<int> &timeout() const { return timeout_; }
+  bool coalesce() const { return coalesce_; }
+  const std::optional<TlsOptions> &tls() const { return tls_; }
+  std::pmr::memory_resource *memory_resource() const {
+    return memory_resource_ != nullptr ? memory_resource_
+                                       : std::pmr::get_default_resource();
+  }
+  bool expect_continue() const { return expect_continue_; }
 
 private:
   RequestOptions(Method method, std::string body,
                  std::multimap<std::string, std::string> headers,
-                 std::optional<int> timeout)
+                 std::optional<int> timeout, bool coalesce,
+                 std::optional<TlsOptions> tls,
+                 std::pmr::memory_resource *memory_resource,
+                 bool expect_continue)
       : method_{method}, body_{std::move(body)}, headers_{std::move(headers)},
-        timeout_{std::move(timeout)} {}
+        timeout_{std::move(timeout)}, coalesce_{coalesce},
+        tls_{std::move(tls)}, memory_resource_{memory_resource},
+        expect_continue_{expect_continue} {}
 
   friend RequestOptionsBuilder;
 
@@ -45,6 +132,10 @@ private:
   std::string body_;
   std::multimap<std::string, std::string> headers_;
   std::optional<int> timeout_;
+  bool coalesce_;
+  std::optional<TlsOptions> tls_;
+  std::pmr::memory_resource *memory_resource_;
+  bool expect_continue_;
 };
 
 class RequestOptionsBuilder {
@@ -70,9 +161,50 @@ public:
     return *this;
   }
 
+  // When enabled, a GET or HEAD request for the same URL, request headers,
+  // body and TLS options as one that is already in flight does not hit the
+  // network. It waits for the in-flight request instead and receives a copy of
+  // its result, on the main context it was made from. Only supported on
+  // Linux, other platforms send every request.
+  RequestOptionsBuilder &set_coalesce(bool coalesce) {
+    coalesce_ = coalesce;
+    return *this;
+  }
+
+  // Requests with equal TLS options share their loaded certificates and, on
+  // Linux, their connections and TLS sessions. The certificate files are read
+  // once, see reload_tls_files() to pick up files that changed.
+  RequestOptionsBuilder &set_tls(TlsOptions tls) {
+    tls_ = std::move(tls);
+    return *this;
+  }
+
+  // The body and headers of the response, along with the buffers the
+  // response is read into, are allocated from `memory_resource`, which has to
+  // outlive the response. Defaults to std::pmr::get_default_resource() at the
+  // time the request is sent.
+  RequestOptionsBuilder &
+  set_memory_resource(std::pmr::memory_resource *memory_resource) {
+    memory_resource_ = memory_resource;
+    return *this;
+  }
+
+  // When enabled, a request with a body is sent with `Expect: 100-continue`
+  // and its body is only sent once the server accepted the headers. A final
+  // response the server sends instead, like 401, 413 or a redirect, is
+  // delivered without sending the body, and redirects are not followed.
+  // Meant for large uploads. Only supported on Linux. If the server answers
+  // neither way within a second of receiving the headers, the request is
+  // resent without the expectation, for servers and proxies that ignore it.
+  RequestOptionsBuilder &set_expect_continue(bool expect_continue) {
+    expect_continue_ = expect_continue;
+    return *this;
+  }
+
   RequestOptions build() {
     return RequestOptions(method_, std::move(body_), std::move(headers_),
-                          std::move(timeout_));
+                          std::move(timeout_), coalesce_, std::move(tls_),
+                          memory_resource_, expect_continue_);
   }
 
 private:
@@ -80,18 +212,120 @@ private:
   std::string body_;
   std::multimap<std::string, std::string> headers_;
   std::optional<int> timeout_;
+  bool coalesce_ = false;
+  std::optional<TlsOptions> tls_;
+  std::pmr::memory_resource *memory_resource_ = nullptr;
+  bool expect_continue_ = false;
 };
 
+using ResponseHeaders =
+    std::pmr::multimap<std::pmr::string, std::pmr::string>;
+
+// The body and headers are allocated from the memory resource of the request.
+// Moving a response keeps its memory resource, while copying one allocates the
+// copy from the default resource.
 struct Response {
-  std::string body;
+  std::pmr::string body;
   uint16_t status;
-  std::multimap<std::string, std::string> headers;
+  ResponseHeaders headers;
 };
 
 auto request(const std::string &url, RequestOptions options,
              std::function<void(std::variant<std::string, Response>)> callback)
     -> void;
 
+// Sends the request and blocks the calling thread until the whole response has
+// been received. This is meant for worker threads: on Linux it uses sessions
+// owned by the calling thread and needs no running main loop.
+auto request_sync(const std::string &url, RequestOptions options)
+    -> std::variant<std::string, Response>;
+
+class EngineOptionsBuilder;
+
+class EngineOptions {
+public:
+  std::size_t io_threads() const { return io_threads_; }
+  std::size_t callback_threads() const { return callback_threads_; }
+
+private:
+  EngineOptions(std::size_t io_threads, std::size_t callback_threads)
+      : io_threads_{io_threads}, callback_threads_{callback_threads} {}
+
+  friend EngineOptionsBuilder;
+
+  std::size_t io_threads_;
+  std::size_t callback_threads_;
+};
+
+class EngineOptionsBuilder {
+public:
+  // Number of threads that run the network I/O. Defaults to the number of
+  // hardware threads.
+  EngineOptionsBuilder &set_io_threads(std::size_t io_threads) {
+    io_threads_ = io_threads;
+    return *this;
+  }
+
+  // Number of threads that run the callbacks. Defaults to the number of
+  // hardware threads.
+  EngineOptionsBuilder &set_callback_threads(std::size_t callback_threads) {
+    callback_threads_ = callback_threads;
+    return *this;
+  }
+
+  EngineOptions build() {
+    return EngineOptions(io_threads_, callback_threads_);
+  }
+
+private:
+  std::size_t io_threads_ = 0;
+  std::size_t callback_threads_ = 0;
+};
+
+// Runs requests on a pool of threads instead of the caller's main loop. On
+// Linux, every I/O thread has its own main context and sessions, and requests
+// are assigned to an I/O thread by a hash of their host so that connections
+// keep being reused. Callbacks run on a separate work-stealing pool of
+// threads. Elsewhere the system HTTP stack is already multi-threaded and
+// requests are forwarded to request().
+class Engine {
+public:
+  explicit Engine(EngineOptions options);
+
+  // On Linux, blocks until every request sent through the engine has completed
+  // and its callback has returned.
+  ~Engine();
+
+  Engine(const Engine &) = delete;
+  Engine &operator=(const Engine &) = delete;
+
+  auto request(const std::string &url, RequestOptions options,
+               std::function<void(std::variant<std::string, Response>)>
+                   callback) -> void;
+
+private:
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+struct TlsStats {
+  // TLS handshakes performed for new connections.
+  uint64_t handshakes;
+  // HTTPS requests sent over an already established connection, which needed
+  // no handshake at all.
+  uint64_t reused_connections;
+};
+
+// Returns the process-wide TLS counters. These are only collected by the
+// libsoup backend and stay at zero elsewhere.
+auto tls_stats() -> TlsStats;
+
+// Makes later requests read their CA and client certificate files again, for
+// instance after a certificate was renewed. Requests in flight and the
+// connections they opened keep the certificates they were loaded with. Only
+// the libsoup backend caches certificates, this is a no-op elsewhere.
+auto reload_tls_files() -> void;
+
 } // namespace benoni
 
 #endif
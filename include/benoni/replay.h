@@ -0,0 +1,30 @@
+#ifndef BENONI_REPLAY_H_
+#define BENONI_REPLAY_H_
+
+#include <optional> // std::optional
+#include <string>   // std::string
+
+namespace benoni {
+
+// Appends every request sent with request() or request_sync() to the archive
+// at `path`, together with its response or error and how long it took. The file
+// is created if it does not exist. Returns an error message if the file cannot
+// be opened.
+auto start_recording(const std::string &path) -> std::optional<std::string>;
+
+auto stop_recording() -> void;
+
+// Serves request() and request_sync() from the archive at `path` instead of the
+// network. Requests are matched by method, URL and body, and the recorded
+// exchanges of a request are served in order, starting over after the last
+// one. Unmatched requests fail. If `emulate_timing` is set, every result is
+// delivered after the recorded duration of the request, otherwise right away.
+// Returns an error message if the archive cannot be mapped or is malformed.
+auto start_replay(const std::string &path, bool emulate_timing = false)
+    -> std::optional<std::string>;
+
+auto stop_replay() -> void;
+
+} // namespace benoni
+
+#endif
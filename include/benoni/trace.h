@@ -0,0 +1,31 @@
+#ifndef BENONI_TRACE_H_
+#define BENONI_TRACE_H_
+
+#include <cstddef> // std::size_t
+#include <string>  // std::string
+
+namespace benoni {
+
+// Starts recording request lifecycle events (enqueue, send, headers, each body
+// chunk, completion and the start and end of the callback). Every thread that
+// records events gets its own lock-free ring buffer holding the most recent
+// `events_per_thread` events. Events recorded before this call are discarded.
+//
+// While tracing is active, each request carries a W3C `traceparent` header. If
+// the request options already contain one, the request joins that trace as a
+// child span, otherwise it starts a new trace.
+//
+// Events are currently recorded by the libsoup backend only.
+auto start_tracing(std::size_t events_per_thread = 8192) -> void;
+
+// Stops recording events. The recorded events remain available to
+// chrome_trace() until the next start_tracing() call.
+auto stop_tracing() -> void;
+
+// Returns the recorded events in the Chrome trace-event JSON format, which can
+// be loaded in chrome://tracing or https://ui.perfetto.dev.
+auto chrome_trace() -> std::string;
+
+} // namespace benoni
+
+#endif
@@ -0,0 +1,134 @@
+#ifndef BENONI_WEBSOCKET_H_
+#define BENONI_WEBSOCKET_H_
+
+#include <benoni/http.h>
+
+#include <cstddef>    // std::size_t
+#include <cstdint>    // uint16_t
+#include <functional> // std::function
+#include <map>        // std::multimap
+#include <memory>     // std::shared_ptr
+#include <optional>   // std::optional
+#include <string>     // std::string
+#include <vector>     // std::vector
+
+namespace benoni {
+
+class WebSocketOptionsBuilder;
+
+class WebSocketOptions {
+public:
+  const std::multimap<std::string, std::string> &headers() const {
+    return headers_;
+  }
+  const std::vector<std::string> &protocols() const { return protocols_; }
+  bool permessage_deflate() const { return permessage_deflate_; }
+  std::size_t high_water_mark() const { return high_water_mark_; }
+  const std::optional<TlsOptions> &tls() const { return tls_; }
+
+private:
+  WebSocketOptions(std::multimap<std::string, std::string> headers,
+                   std::vector<std::string> protocols, bool permessage_deflate,
+                   std::size_t high_water_mark, std::optional<TlsOptions> tls)
+      : headers_{std::move(headers)}, protocols_{std::move(protocols)},
+        permessage_deflate_{permessage_deflate},
+        high_water_mark_{high_water_mark}, tls_{std::move(tls)} {}
+
+  friend WebSocketOptionsBuilder;
+
+  std::multimap<std::string, std::string> headers_;
+  std::vector<std::string> protocols_;
+  bool permessage_deflate_;
+  std::size_t high_water_mark_;
+  std::optional<TlsOptions> tls_;
+};
+
+class WebSocketOptionsBuilder {
+public:
+  WebSocketOptionsBuilder &
+  set_headers(std::multimap<std::string, std::string> headers) {
+    headers_ = std::move(headers);
+    return *this;
+  }
+
+  // Subprotocols offered in the `Sec-WebSocket-Protocol` header.
+  WebSocketOptionsBuilder &set_protocols(std::vector<std::string> protocols) {
+    protocols_ = std::move(protocols);
+    return *this;
+  }
+
+  // Offers the permessage-deflate extension to the server.
+  WebSocketOptionsBuilder &set_permessage_deflate(bool permessage_deflate) {
+    permessage_deflate_ = permessage_deflate;
+    return *this;
+  }
+
+  // Number of buffered outgoing bytes above which the send methods of
+  // WebSocket return false.
+  WebSocketOptionsBuilder &set_high_water_mark(std::size_t high_water_mark) {
+    high_water_mark_ = high_water_mark;
+    return *this;
+  }
+
+  WebSocketOptionsBuilder &set_tls(TlsOptions tls) {
+    tls_ = std::move(tls);
+    return *this;
+  }
+
+  WebSocketOptions build() {
+    return WebSocketOptions(std::move(headers_), std::move(protocols_),
+                            permessage_deflate_, high_water_mark_,
+                            std::move(tls_));
+  }
+
+private:
+  std::multimap<std::string, std::string> headers_;
+  std::vector<std::string> protocols_;
+  bool permessage_deflate_ = false;
+  std::size_t high_water_mark_ = 1024 * 1024;
+  std::optional<TlsOptions> tls_;
+};
+
+// An open WebSocket connection. Its methods must be called from the thread
+// that runs the main loop the connection was opened from.
+class WebSocket {
+public:
+  virtual ~WebSocket() = default;
+
+  // Send a message. Messages that the connection cannot write yet are
+  // buffered. Returns false once more than the high water mark is buffered:
+  // the message is still sent, but the caller should wait for `on_drain`
+  // before sending more.
+  virtual auto send_text(std::string message) -> bool = 0;
+  virtual auto send_binary(std::string data) -> bool = 0;
+
+  // Number of outgoing bytes that are buffered.
+  virtual auto buffered_amount() const -> std::size_t = 0;
+
+  virtual auto close(uint16_t code = 1000, std::string reason = {}) -> void = 0;
+};
+
+struct WebSocketHandlers {
+  std::function<void(std::shared_ptr<WebSocket>)> on_open;
+  std::function<void(std::string)> on_message;
+  std::function<void(std::string)> on_binary;
+  // Called once the buffered outgoing bytes have been written after a send
+  // method returned false.
+  std::function<void()> on_drain;
+  std::function<void(uint16_t code, std::string reason)> on_close;
+  std::function<void(std::string)> on_error;
+};
+
+// Opens a WebSocket connection to a `ws://` or `wss://` URL. Either `on_open`
+// or `on_error` is called once the opening handshake finishes. The connection
+// stays open until it is closed by either side, even if the WebSocket passed to
+// `on_open` is released.
+//
+// Only the libsoup backend supports WebSockets, elsewhere `on_error` is called
+// right away.
+auto websocket_connect(const std::string &url, WebSocketOptions options,
+                       WebSocketHandlers handlers) -> void;
+
+} // namespace benoni
+
+#endif
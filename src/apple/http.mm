@@ -1,18 +1,25 @@
 #include <benoni/http.h>
+#include <benoni/websocket.h>
+
+#include "common/concurrency.h"
+#include "common/replay.h"
 
 #import <Foundation/Foundation.h>
 
-#include <map>     // std::map
-#include <sstream> // std::istringstream
-#include <string>  // std::string
-#include <variant> // std::variant
+#include <chrono>          // std::chrono
+#include <future>          // std::promise
+#include <map>             // std::map
+#include <memory_resource> // std::pmr::string
+#include <sstream>         // std::istringstream
+#include <string>          // std::string
+#include <variant>         // std::variant
 
 namespace {
 
 struct HTTPTaskContext {
   std::function<void(std::variant<std::string, benoni::Response>)> callback;
   uint16_t status;
-  std::multimap<std::string, std::string> headers;
+  benoni::ResponseHeaders headers;
   NSMutableData *data;
   NSStringEncoding encoding;
 };
@@ -176,7 +183,8 @@ struct HTTPTaskContext {
     return;
   }
 
-  std::string body{[responseString UTF8String]};
+  std::pmr::string body{[responseString UTF8String],
+                        context->headers.get_allocator()};
 
   benoni::Response response{
       .body = std::move(body),
@@ -184,15 +192,20 @@ struct HTTPTaskContext {
       .headers = std::move(context->headers),
   };
   contextMap_[key] = nil;
-  callback(response);
+  callback(std::move(response));
 }
 @end
 
 namespace benoni {
 
-auto request(const std::string &url, RequestOptions options,
-             std::function<void(std::variant<std::string, Response>)> callback)
-    -> void {
+namespace {
+
+// Sends a request that the concurrency limiter let through.
+auto send_request(
+    const std::string &url, RequestOptions options,
+    std::function<void(std::variant<std::string, Response>)> callback) -> void {
+  callback = replay::record_callback(url, options, std::move(callback));
+
   BenoniHTTPSessionDelegate *delegate =
       [[BenoniHTTPSessionDelegate alloc] init];
   NSURLSessionConfiguration *configuration =
@@ -241,7 +254,10 @@ auto request(const std::string &url, RequestOptions options,
   NSURLSessionDataTask *data_task = [session dataTaskWithRequest:request];
   NSMutableDictionary<NSNumber *, BenoniHTTPTaskContextWrap *> *contextMap =
       [delegate contextMap];
-  auto *context{new HTTPTaskContext{.callback = std::move(callback)}};
+  auto *context{new HTTPTaskContext{
+      .callback = std::move(callback),
+      .status = 0,
+      .headers = ResponseHeaders{options.memory_resource()}}};
   BenoniHTTPTaskContextWrap *contextWrap =
       [[BenoniHTTPTaskContextWrap alloc] initWithContext:context];
   [contextMap
@@ -251,4 +267,84 @@ auto request(const std::string &url, RequestOptions options,
   [data_task resume];
 }
 
+} // namespace
+
+auto request(const std::string &url, RequestOptions options,
+             std::function<void(std::variant<std::string, Response>)> callback)
+    -> void {
+  if (auto replayed = replay::find(url, options)) {
+    std::variant<std::string, Response> result{std::move(replayed->result)};
+    dispatch_after(
+        dispatch_time(DISPATCH_TIME_NOW, replayed->delay.count()),
+        dispatch_get_global_queue(QOS_CLASS_DEFAULT, 0), ^{
+          callback(result);
+        });
+    return;
+  }
+
+  concurrency::dispatch(
+      url, std::move(callback),
+      [url, options = std::move(options)](
+          std::function<void(std::variant<std::string, Response>)>
+              callback) mutable {
+        send_request(url, std::move(options), std::move(callback));
+      },
+      [](std::chrono::milliseconds delay, std::function<void()> task) {
+        dispatch_after(
+            dispatch_time(
+                DISPATCH_TIME_NOW,
+                std::chrono::duration_cast<std::chrono::nanoseconds>(delay)
+                    .count()),
+            dispatch_get_global_queue(QOS_CLASS_DEFAULT, 0), ^{
+              task();
+            });
+      });
+}
+
+auto request_sync(const std::string &url, RequestOptions options)
+    -> std::variant<std::string, Response> {
+  // The callback runs on the delegate queue of the session, so the calling
+  // thread can block until it does.
+  std::promise<std::variant<std::string, Response>> promise;
+  auto future = promise.get_future();
+  request(url, std::move(options),
+          [&promise](std::variant<std::string, Response> result) {
+            promise.set_value(std::move(result));
+          });
+  return future.get();
+}
+
+// The system HTTP stack already runs requests on its own threads, so the
+// engine forwards them to request().
+class Engine::Impl {};
+
+Engine::Engine(EngineOptions /* options */)
+    : impl_{std::make_unique<Impl>()} {}
+
+Engine::~Engine() = default;
+
+auto Engine::request(
+    const std::string &url, RequestOptions options,
+    std::function<void(std::variant<std::string, Response>)> callback) -> void {
+  benoni::request(url, std::move(options), std::move(callback));
+}
+
+auto websocket_connect(const std::string & /* url */,
+                       WebSocketOptions /* options */,
+                       WebSocketHandlers handlers) -> void {
+  if (handlers.on_error) {
+    handlers.on_error("WebSocket is not supported on this platform");
+  }
+}
+
+auto tls_stats() -> TlsStats {
+  // The system HTTP stack manages TLS sessions here and does not expose
+  // handshake counts.
+  return TlsStats{.handshakes = 0, .reused_connections = 0};
+}
+
+auto reload_tls_files() -> void {
+  // Certificate files are not cached here.
+}
+
 } // namespace benoni
@@ -0,0 +1,262 @@
+#include <benoni/concurrency.h>
+
+#include "common/concurrency.h"
+#include "common/url.h"
+
+#include <algorithm>     // std::clamp, std::find_if, std::max
+#include <atomic>        // std::atomic
+#include <chrono>        // std::chrono
+#include <cstdint>       // uint64_t
+#include <deque>         // std::deque
+#include <functional>    // std::function
+#include <memory>        // std::make_shared, std::enable_shared_from_this
+#include <mutex>         // std::mutex, std::lock_guard
+#include <optional>      // std::optional
+#include <string>        // std::string
+#include <unordered_map> // std::unordered_map
+#include <variant>       // std::variant, std::get_if
+#include <vector>        // std::vector
+
+namespace benoni {
+namespace {
+
+// After this many samples the lowest round-trip time is measured afresh, so
+// that the limiter follows a host whose baseline latency has changed.
+constexpr uint64_t kMinRttResetSamples = 1000;
+
+constexpr const char *kQueueTimeoutError =
+    "Timed out waiting for the concurrency limit of the host";
+
+// The in-flight limit of a single host, adjusted with additive increase and
+// multiplicative decrease: every request that completes in time while the host
+// uses at least half of its limit adds 1 / limit, so the limit grows by about
+// one per round trip, and every failed or slow request multiplies it by the
+// backoff ratio. A host that is far below its limit does not raise it, so that
+// the limit still protects the host when load picks up.
+class HostLimiter : public std::enable_shared_from_this<HostLimiter> {
+public:
+  explicit HostLimiter(const AdaptiveConcurrencyOptions &options)
+      : options_{options},
+        limit_{static_cast<double>(std::clamp(options.initial_limit(),
+                                              options.min_limit(),
+                                              options.max_limit()))} {}
+
+  auto Dispatch(
+      std::function<void(std::variant<std::string, Response>)> callback,
+      std::function<void(
+          std::function<void(std::variant<std::string, Response>)>)>
+          send,
+      const concurrency::Timer &timer) -> void {
+    std::vector<Waiting> expired;
+    bool start = false;
+    std::optional<uint64_t> queued_id;
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      TakeExpired(expired);
+      if (queue_.empty() && inflight_ < Limit()) {
+        ++inflight_;
+        start = true;
+      } else if (queue_.size() < options_.max_queue()) {
+        queued_id = next_id_++;
+        queue_.push_back(Waiting{
+            .id = queued_id.value(),
+            .deadline =
+                std::chrono::steady_clock::now() + options_.max_queue_wait(),
+            .callback = std::move(callback),
+            .send = std::move(send),
+            .timer = timer});
+      }
+    }
+
+    RejectExpired(expired);
+    if (start) {
+      Start(std::move(callback), std::move(send));
+    } else if (queued_id.has_value()) {
+      // Rejects the request even if no request to the host completes in time.
+      timer(options_.max_queue_wait(),
+            [self = shared_from_this(), id = queued_id.value()]() {
+              self->Expire(id);
+            });
+    } else {
+      callback("Concurrency limit reached for the host");
+    }
+  }
+
+private:
+  struct Waiting {
+    uint64_t id;
+    std::chrono::steady_clock::time_point deadline;
+    std::function<void(std::variant<std::string, Response>)> callback;
+    std::function<void(
+        std::function<void(std::variant<std::string, Response>)>)>
+        send;
+    // Runs the start or the rejection of the request on a thread of the
+    // caller, rather than on the thread of whichever request made room for it.
+    concurrency::Timer timer;
+  };
+
+  auto Limit() const -> std::size_t {
+    return std::max(options_.min_limit(), static_cast<std::size_t>(limit_));
+  }
+
+  // Moves the waiting requests at the front of the queue that waited for too
+  // long to `expired`.
+  auto TakeExpired(std::vector<Waiting> &expired) -> void {
+    auto now = std::chrono::steady_clock::now();
+    while (!queue_.empty() && queue_.front().deadline < now) {
+      expired.push_back(std::move(queue_.front()));
+      queue_.pop_front();
+    }
+  }
+
+  static auto RejectExpired(std::vector<Waiting> &expired) -> void {
+    for (auto &waiting : expired) {
+      waiting.timer(std::chrono::milliseconds::zero(),
+                    [callback = std::move(waiting.callback)]() {
+                      callback(kQueueTimeoutError);
+                    });
+    }
+  }
+
+  // Rejects the waiting request `id` unless it was started or rejected
+  // already.
+  auto Expire(uint64_t id) -> void {
+    std::function<void(std::variant<std::string, Response>)> callback;
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      auto waiting = std::find_if(
+          queue_.begin(), queue_.end(),
+          [id](const Waiting &waiting) { return waiting.id == id; });
+      if (waiting == queue_.end()) {
+        return;
+      }
+      callback = std::move(waiting->callback);
+      queue_.erase(waiting);
+    }
+    callback(kQueueTimeoutError);
+  }
+
+  auto Start(
+      std::function<void(std::variant<std::string, Response>)> callback,
+      std::function<void(
+          std::function<void(std::variant<std::string, Response>)>)>
+          send) -> void {
+    // Only the first result of a request counts, a backend that reports more
+    // than one would otherwise complete it again and corrupt `inflight_`.
+    send([self = shared_from_this(), start = std::chrono::steady_clock::now(),
+          completed = std::make_shared<std::atomic<bool>>(false),
+          callback = std::move(callback)](
+             std::variant<std::string, Response> result) {
+      if (completed->exchange(true)) {
+        return;
+      }
+      const Response *response = std::get_if<Response>(&result);
+      bool dropped = response == nullptr || response->status == 429 ||
+                     response->status >= 500;
+      self->Complete(std::chrono::steady_clock::now() - start, dropped);
+      callback(std::move(result));
+    });
+  }
+
+  auto Complete(std::chrono::steady_clock::duration rtt, bool dropped) -> void {
+    std::vector<Waiting> expired;
+    std::vector<Waiting> ready;
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      // Includes the request that completed.
+      std::size_t inflight = inflight_--;
+
+      if (samples_++ % kMinRttResetSamples == 0 || rtt < min_rtt_) {
+        min_rtt_ = rtt;
+      }
+
+      double limit = limit_;
+      if (dropped || rtt > min_rtt_ * options_.latency_tolerance()) {
+        limit *= options_.backoff_ratio();
+      } else if (static_cast<double>(inflight * 2) >= limit) {
+        limit += 1.0 / limit;
+      }
+      limit_ = std::clamp(limit, static_cast<double>(options_.min_limit()),
+                          static_cast<double>(options_.max_limit()));
+
+      TakeExpired(expired);
+      while (!queue_.empty() && inflight_ < Limit()) {
+        ready.push_back(std::move(queue_.front()));
+        queue_.pop_front();
+        ++inflight_;
+      }
+    }
+
+    RejectExpired(expired);
+    for (auto &waiting : ready) {
+      waiting.timer(std::chrono::milliseconds::zero(),
+                    [self = shared_from_this(),
+                     callback = std::move(waiting.callback),
+                     send = std::move(waiting.send)]() {
+                      self->Start(callback, send);
+                    });
+    }
+  }
+
+  AdaptiveConcurrencyOptions options_;
+
+  std::mutex mutex_;
+  double limit_;
+  std::size_t inflight_ = 0;
+  std::chrono::steady_clock::duration min_rtt_{};
+  uint64_t samples_ = 0;
+  uint64_t next_id_ = 0;
+  std::deque<Waiting> queue_;
+};
+
+std::mutex limiters_mutex;
+std::optional<AdaptiveConcurrencyOptions> limiter_options;
+std::unordered_map<std::string, std::shared_ptr<HostLimiter>> limiters;
+
+} // namespace
+
+namespace concurrency {
+
+auto dispatch(
+    const std::string &url,
+    std::function<void(std::variant<std::string, Response>)> callback,
+    std::function<void(
+        std::function<void(std::variant<std::string, Response>)>)>
+        send,
+    const Timer &timer) -> void {
+  std::shared_ptr<HostLimiter> limiter;
+  {
+    std::lock_guard<std::mutex> lock{limiters_mutex};
+    if (limiter_options.has_value()) {
+      auto [host_limiter, inserted] =
+          limiters.try_emplace(std::string{host_of(url)});
+      if (inserted) {
+        host_limiter->second =
+            std::make_shared<HostLimiter>(limiter_options.value());
+      }
+      limiter = host_limiter->second;
+    }
+  }
+
+  if (limiter == nullptr) {
+    send(std::move(callback));
+    return;
+  }
+  limiter->Dispatch(std::move(callback), std::move(send), timer);
+}
+
+} // namespace concurrency
+
+auto enable_adaptive_concurrency(AdaptiveConcurrencyOptions options) -> void {
+  std::lock_guard<std::mutex> lock{limiters_mutex};
+  limiter_options = std::move(options);
+  limiters.clear();
+}
+
+auto disable_adaptive_concurrency() -> void {
+  std::lock_guard<std::mutex> lock{limiters_mutex};
+  limiter_options.reset();
+  limiters.clear();
+}
+
+} // namespace benoni
@@ -0,0 +1,37 @@
+#ifndef BENONI_COMMON_CONCURRENCY_H_
+#define BENONI_COMMON_CONCURRENCY_H_
+
+#include <benoni/http.h>
+
+#include <chrono>     // std::chrono::milliseconds
+#include <functional> // std::function
+#include <string>     // std::string
+#include <variant>    // std::variant
+
+namespace benoni::concurrency {
+
+// Calls `task` once `delay` has passed, on a thread the backend may call the
+// callback of the request from, like the thread-default main context of the
+// caller on Linux. The limiter also starts and rejects queued requests through
+// the timer of each request with no delay, so that they do not run on the
+// thread of the request that made room for them.
+using Timer = std::function<void(std::chrono::milliseconds delay,
+                                 std::function<void()> task)>;
+
+// Calls `send` with `callback` once the host of `url` is below its concurrency
+// limit, or right away if adaptive concurrency is disabled. `send` must call
+// the callback it is given at least once, calls after the first are ignored
+// while the limiter is enabled. The callback is called with an error instead
+// if the request is rejected by the limiter, either right away or through
+// `timer` once it waited in the queue for too long.
+auto dispatch(
+    const std::string &url,
+    std::function<void(std::variant<std::string, Response>)> callback,
+    std::function<void(
+        std::function<void(std::variant<std::string, Response>)>)>
+        send,
+    const Timer &timer) -> void;
+
+} // namespace benoni::concurrency
+
+#endif
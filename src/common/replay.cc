@@ -0,0 +1,478 @@
+#include <benoni/replay.h>
+
+#include "common/replay.h"
+
+#if defined(_WIN32)
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <cstdio>          // std::FILE, std::fopen, std::fwrite
+#include <cstring>         // std::memcpy
+#include <memory>          // std::shared_ptr
+#include <memory_resource> // std::pmr::memory_resource, std::pmr::string
+#include <mutex>           // std::mutex, std::lock_guard
+#include <string>          // std::string
+#include <string_view>     // std::string_view
+#include <unordered_map>   // std::unordered_map
+#include <vector>          // std::vector
+
+// Archive format, all integers in host byte order:
+//
+//   archive  := magic record*
+//   magic    := "BENONIR1"
+//   record   := u32 size, followed by `size` bytes of:
+//               u8 kind (0 = response, 1 = error)
+//               u8 method
+//               u16 status
+//               u64 start (nanoseconds since the recording started)
+//               u64 duration (nanoseconds)
+//               string url
+//               string request body
+//               headers request headers
+//               headers response headers
+//               string response body or error message
+//   string   := u32 length, bytes
+//   headers  := u32 count, (string name, string value)*
+
+namespace benoni {
+namespace {
+
+using replay::Replayed;
+
+constexpr std::string_view kMagic{"BENONIR1"};
+
+enum class RecordKind : uint8_t {
+  kResponse = 0,
+  kError = 1,
+};
+
+template <typename T>
+auto append_integer(std::string &buffer, T value) -> void {
+  char bytes[sizeof(T)];
+  std::memcpy(bytes, &value, sizeof(T));
+  buffer.append(bytes, sizeof(T));
+}
+
+auto append_string(std::string &buffer, std::string_view value) -> void {
+  append_integer(buffer, static_cast<uint32_t>(value.size()));
+  buffer.append(value);
+}
+
+// Appends request headers as well as response headers, which use a different
+// string type.
+template <typename Headers>
+auto append_headers(std::string &buffer, const Headers &headers) -> void {
+  append_integer(buffer, static_cast<uint32_t>(headers.size()));
+  for (const auto &[name, value] : headers) {
+    append_string(buffer, name);
+    append_string(buffer, value);
+  }
+}
+
+// Reads the fields of a record from the mapped archive. Every read checks the
+// bounds, so a truncated or corrupted archive is reported instead of read past
+// its end.
+class Reader {
+public:
+  Reader(const char *data, std::size_t size) : data_{data}, size_{size} {}
+
+  template <typename T> auto ReadInteger(T &value) -> bool {
+    if (size_ - offset_ < sizeof(T)) {
+      return false;
+    }
+    std::memcpy(&value, data_ + offset_, sizeof(T));
+    offset_ += sizeof(T);
+    return true;
+  }
+
+  auto ReadString(std::string_view &value) -> bool {
+    uint32_t length = 0;
+    if (!ReadInteger(length) || size_ - offset_ < length) {
+      return false;
+    }
+    value = std::string_view{data_ + offset_, length};
+    offset_ += length;
+    return true;
+  }
+
+  auto ReadHeaders(ResponseHeaders *headers) -> bool {
+    uint32_t count = 0;
+    if (!ReadInteger(count)) {
+      return false;
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+      std::string_view name;
+      std::string_view value;
+      if (!ReadString(name) || !ReadString(value)) {
+        return false;
+      }
+      if (headers != nullptr) {
+        headers->emplace(name, value);
+      }
+    }
+    return true;
+  }
+
+private:
+  const char *data_;
+  std::size_t size_;
+  std::size_t offset_ = 0;
+};
+
+struct RecordView {
+  RecordKind kind;
+  uint8_t method;
+  uint16_t status;
+  uint64_t duration;
+  std::string_view url;
+  std::string_view request_body;
+};
+
+auto read_record_view(Reader &reader, RecordView &record) -> bool {
+  uint8_t kind = 0;
+  uint64_t start = 0;
+  if (!reader.ReadInteger(kind) || !reader.ReadInteger(record.method) ||
+      !reader.ReadInteger(record.status) || !reader.ReadInteger(start) ||
+      !reader.ReadInteger(record.duration) || !reader.ReadString(record.url) ||
+      !reader.ReadString(record.request_body) ||
+      !reader.ReadHeaders(nullptr)) {
+    return false;
+  }
+  record.kind = static_cast<RecordKind>(kind);
+  return kind <= static_cast<uint8_t>(RecordKind::kError);
+}
+
+auto exchange_key(uint8_t method, std::string_view url,
+                  std::string_view request_body) -> std::string {
+  std::string key;
+  key.reserve(url.size() + request_body.size() + 2);
+  key += static_cast<char>(method);
+  key += url;
+  key += '\0';
+  key += request_body;
+  return key;
+}
+
+// A read-only mapping of an archive file.
+class MappedFile {
+public:
+  ~MappedFile() {
+#if defined(_WIN32)
+    if (data_ != nullptr) {
+      UnmapViewOfFile(data_);
+    }
+#else
+    if (data_ != nullptr) {
+      munmap(const_cast<char *>(data_), size_);
+    }
+#endif
+  }
+
+  auto Map(const std::string &path) -> std::optional<std::string> {
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                              nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                              nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+      return "Could not open the archive: " + path;
+    }
+    LARGE_INTEGER file_size;
+    if (GetFileSizeEx(file, &file_size) == FALSE) {
+      CloseHandle(file);
+      return "Could not read the size of the archive: " + path;
+    }
+    size_ = static_cast<std::size_t>(file_size.QuadPart);
+    if (size_ == 0) {
+      CloseHandle(file);
+      return "The archive is empty: " + path;
+    }
+    HANDLE mapping =
+        CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (mapping == nullptr) {
+      return "Could not map the archive: " + path;
+    }
+    data_ = static_cast<const char *>(
+        MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    CloseHandle(mapping);
+    if (data_ == nullptr) {
+      return "Could not map the archive: " + path;
+    }
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+      return "Could not open the archive: " + path;
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) == -1) {
+      close(fd);
+      return "Could not read the size of the archive: " + path;
+    }
+    size_ = static_cast<std::size_t>(file_stat.st_size);
+    if (size_ == 0) {
+      close(fd);
+      return "The archive is empty: " + path;
+    }
+    void *data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+      return "Could not map the archive: " + path;
+    }
+    data_ = static_cast<const char *>(data);
+#endif
+    return std::nullopt;
+  }
+
+  auto data() const -> const char * { return data_; }
+  auto size() const -> std::size_t { return size_; }
+
+private:
+  const char *data_ = nullptr;
+  std::size_t size_ = 0;
+};
+
+class ReplayArchive {
+public:
+  explicit ReplayArchive(bool emulate_timing)
+      : emulate_timing_{emulate_timing} {}
+
+  auto Open(const std::string &path) -> std::optional<std::string> {
+    if (auto error = file_.Map(path)) {
+      return error;
+    }
+
+    if (file_.size() < kMagic.size() ||
+        std::string_view{file_.data(), kMagic.size()} != kMagic) {
+      return "Not a benoni archive: " + path;
+    }
+
+    // Indexes the records. A record cut short by a crash while recording ends
+    // the archive.
+    std::size_t offset = kMagic.size();
+    while (file_.size() - offset >= sizeof(uint32_t)) {
+      uint32_t size = 0;
+      std::memcpy(&size, file_.data() + offset, sizeof(size));
+      offset += sizeof(size);
+      if (file_.size() - offset < size) {
+        break;
+      }
+
+      Reader reader{file_.data() + offset, size};
+      RecordView record;
+      if (!read_record_view(reader, record)) {
+        return "Malformed record in the archive: " + path;
+      }
+      exchanges_[exchange_key(record.method, record.url, record.request_body)]
+          .offsets.push_back(offset);
+      offset += size;
+    }
+    return std::nullopt;
+  }
+
+  auto Find(std::string_view url, const RequestOptions &options)
+      -> std::optional<Replayed> {
+    std::size_t offset = 0;
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      auto exchange = exchanges_.find(exchange_key(
+          static_cast<uint8_t>(options.method()), url, options.body()));
+      if (exchange == exchanges_.end()) {
+        return std::nullopt;
+      }
+      Exchange &recorded = exchange->second;
+      offset = recorded.offsets[recorded.next];
+      recorded.next = (recorded.next + 1) % recorded.offsets.size();
+    }
+
+    uint32_t size = 0;
+    std::memcpy(&size, file_.data() + offset - sizeof(size), sizeof(size));
+    Reader reader{file_.data() + offset, size};
+    RecordView record;
+    std::pmr::memory_resource *memory_resource = options.memory_resource();
+    Response response{.body = std::pmr::string{memory_resource},
+                      .status = 0,
+                      .headers = ResponseHeaders{memory_resource}};
+    std::string_view body;
+    // The record was validated while indexing, apart from its tail.
+    if (!read_record_view(reader, record) ||
+        !reader.ReadHeaders(&response.headers) || !reader.ReadString(body)) {
+      return Replayed{.result = "Malformed record in the archive",
+                      .delay = std::chrono::nanoseconds{0}};
+    }
+
+    auto delay = std::chrono::nanoseconds{
+        emulate_timing_ ? static_cast<int64_t>(record.duration) : 0};
+    if (record.kind == RecordKind::kError) {
+      return Replayed{.result = std::string{body}, .delay = delay};
+    }
+    response.status = record.status;
+    response.body.assign(body);
+    return Replayed{.result = std::move(response), .delay = delay};
+  }
+
+private:
+  struct Exchange {
+    std::vector<std::size_t> offsets;
+    std::size_t next = 0;
+  };
+
+  MappedFile file_;
+  bool emulate_timing_;
+
+  std::mutex mutex_;
+  std::unordered_map<std::string, Exchange> exchanges_;
+};
+
+std::mutex recording_mutex;
+std::FILE *recording_file = nullptr;
+std::chrono::steady_clock::time_point recording_start;
+
+std::mutex replay_mutex;
+std::shared_ptr<ReplayArchive> replay_archive;
+
+} // namespace
+
+namespace replay {
+
+auto find(const std::string &url, const RequestOptions &options)
+    -> std::optional<Replayed> {
+  std::shared_ptr<ReplayArchive> archive;
+  {
+    std::lock_guard<std::mutex> lock{replay_mutex};
+    archive = replay_archive;
+  }
+  if (archive == nullptr) {
+    return std::nullopt;
+  }
+
+  std::optional<Replayed> replayed = archive->Find(url, options);
+  if (!replayed.has_value()) {
+    return Replayed{.result = "No recorded response for " + url,
+                    .delay = std::chrono::nanoseconds{0}};
+  }
+  return replayed;
+}
+
+auto record_callback(
+    const std::string &url, const RequestOptions &options,
+    std::function<void(std::variant<std::string, Response>)> callback)
+    -> std::function<void(std::variant<std::string, Response>)> {
+  {
+    std::lock_guard<std::mutex> lock{recording_mutex};
+    if (recording_file == nullptr) {
+      return callback;
+    }
+  }
+
+  return [url, options, start = std::chrono::steady_clock::now(),
+          callback = std::move(callback)](
+             std::variant<std::string, Response> result) {
+    record(url, options, start, result);
+    callback(std::move(result));
+  };
+}
+
+auto record(const std::string &url, const RequestOptions &options,
+            std::chrono::steady_clock::time_point start,
+            const std::variant<std::string, Response> &result) -> void {
+  auto end = std::chrono::steady_clock::now();
+
+  std::lock_guard<std::mutex> lock{recording_mutex};
+  if (recording_file == nullptr) {
+    return;
+  }
+
+  const Response *response = std::get_if<Response>(&result);
+  std::string record;
+  append_integer(record, static_cast<uint8_t>(response != nullptr
+                                                  ? RecordKind::kResponse
+                                                  : RecordKind::kError));
+  append_integer(record, static_cast<uint8_t>(options.method()));
+  append_integer(record,
+                 static_cast<uint16_t>(response != nullptr ? response->status
+                                                           : 0));
+  append_integer(record,
+                 static_cast<uint64_t>(
+                     start > recording_start
+                         ? std::chrono::duration_cast<std::chrono::nanoseconds>(
+                               start - recording_start)
+                               .count()
+                         : 0));
+  append_integer(record,
+                 static_cast<uint64_t>(
+                     std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         end - start)
+                         .count()));
+  append_string(record, url);
+  append_string(record, options.body());
+  append_headers(record, options.headers());
+  if (response != nullptr) {
+    append_headers(record, response->headers);
+    append_string(record, response->body);
+  } else {
+    append_headers(record, ResponseHeaders{});
+    append_string(record, std::get<std::string>(result));
+  }
+
+  std::string size;
+  append_integer(size, static_cast<uint32_t>(record.size()));
+  std::fwrite(size.data(), 1, size.size(), recording_file);
+  std::fwrite(record.data(), 1, record.size(), recording_file);
+  std::fflush(recording_file);
+}
+
+} // namespace replay
+
+auto start_recording(const std::string &path) -> std::optional<std::string> {
+  std::FILE *file = std::fopen(path.c_str(), "ab");
+  if (file == nullptr) {
+    return "Could not open the archive: " + path;
+  }
+
+  // A new archive starts with the magic, an existing one is appended to.
+  std::fseek(file, 0, SEEK_END);
+  if (std::ftell(file) == 0) {
+    std::fwrite(kMagic.data(), 1, kMagic.size(), file);
+    std::fflush(file);
+  }
+
+  std::lock_guard<std::mutex> lock{recording_mutex};
+  if (recording_file != nullptr) {
+    std::fclose(recording_file);
+  }
+  recording_file = file;
+  recording_start = std::chrono::steady_clock::now();
+  return std::nullopt;
+}
+
+auto stop_recording() -> void {
+  std::lock_guard<std::mutex> lock{recording_mutex};
+  if (recording_file != nullptr) {
+    std::fclose(recording_file);
+    recording_file = nullptr;
+  }
+}
+
+auto start_replay(const std::string &path, bool emulate_timing)
+    -> std::optional<std::string> {
+  auto archive = std::make_shared<ReplayArchive>(emulate_timing);
+  if (auto error = archive->Open(path)) {
+    return error;
+  }
+
+  std::lock_guard<std::mutex> lock{replay_mutex};
+  replay_archive = std::move(archive);
+  return std::nullopt;
+}
+
+auto stop_replay() -> void {
+  std::lock_guard<std::mutex> lock{replay_mutex};
+  replay_archive.reset();
+}
+
+} // namespace benoni
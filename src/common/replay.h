@@ -0,0 +1,39 @@
+#ifndef BENONI_COMMON_REPLAY_H_
+#define BENONI_COMMON_REPLAY_H_
+
+#include <benoni/http.h>
+
+#include <chrono>     // std::chrono
+#include <functional> // std::function
+#include <optional>   // std::optional
+#include <string>     // std::string
+#include <variant>    // std::variant
+
+namespace benoni::replay {
+
+struct Replayed {
+  std::variant<std::string, Response> result;
+  // How long to wait before delivering the result.
+  std::chrono::nanoseconds delay;
+};
+
+// Returns the recorded result for the request if replay is active.
+auto find(const std::string &url, const RequestOptions &options)
+    -> std::optional<Replayed>;
+
+// Returns a callback that appends the result of the request to the archive
+// before calling `callback` if recording is active, otherwise `callback`.
+auto record_callback(
+    const std::string &url, const RequestOptions &options,
+    std::function<void(std::variant<std::string, Response>)> callback)
+    -> std::function<void(std::variant<std::string, Response>)>;
+
+// Appends the result of a request that started at `start` to the archive if
+// recording is active.
+auto record(const std::string &url, const RequestOptions &options,
+            std::chrono::steady_clock::time_point start,
+            const std::variant<std::string, Response> &result) -> void;
+
+} // namespace benoni::replay
+
+#endif
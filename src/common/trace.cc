@@ -0,0 +1,272 @@
+#include <benoni/trace.h>
+
+#include "common/trace.h"
+
+#include <atomic>  // std::atomic
+#include <chrono>  // std::chrono
+#include <cstdio>  // std::snprintf
+#include <memory>  // std::shared_ptr, std::unique_ptr
+#include <mutex>   // std::mutex, std::lock_guard
+#include <random>  // std::mt19937_64, std::random_device
+#include <sstream> // std::ostringstream
+#include <string>  // std::string
+#include <vector>  // std::vector
+
+namespace benoni {
+namespace {
+
+struct Slot {
+  // Odd while the slot is being written, 2 * (index + 1) once the event with
+  // that index has been written.
+  std::atomic<uint64_t> sequence{0};
+  std::atomic<uint64_t> timestamp{0};
+  std::atomic<uint64_t> request_id{0};
+  std::atomic<uint64_t> value{0};
+  std::atomic<uint8_t> event{0};
+};
+
+struct EventRecord {
+  uint64_t timestamp;
+  uint64_t request_id;
+  uint64_t value;
+  trace::Event event;
+  uint64_t thread_id;
+};
+
+// A single-producer ring buffer owned by one thread. Readers use the sequence
+// numbers of the slots to skip events that are overwritten while being read.
+class ThreadBuffer {
+public:
+  ThreadBuffer(std::size_t capacity, uint64_t thread_id)
+      : slots_{std::make_unique<Slot[]>(capacity)}, capacity_{capacity},
+        thread_id_{thread_id} {}
+
+  auto push(trace::Event event, uint64_t request_id, uint64_t value,
+            uint64_t timestamp) -> void {
+    uint64_t index = head_.load(std::memory_order_relaxed);
+    Slot &slot = slots_[index % capacity_];
+    slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.timestamp.store(timestamp, std::memory_order_relaxed);
+    slot.request_id.store(request_id, std::memory_order_relaxed);
+    slot.value.store(value, std::memory_order_relaxed);
+    slot.event.store(static_cast<uint8_t>(event), std::memory_order_relaxed);
+    slot.sequence.store(2 * index + 2, std::memory_order_release);
+    head_.store(index + 1, std::memory_order_release);
+  }
+
+  auto collect(std::vector<EventRecord> &records) const -> void {
+    uint64_t head = head_.load(std::memory_order_acquire);
+    uint64_t begin = head > capacity_ ? head - capacity_ : 0;
+    for (uint64_t index = begin; index < head; ++index) {
+      const Slot &slot = slots_[index % capacity_];
+      uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+      if (sequence != 2 * index + 2) {
+        continue;
+      }
+
+      EventRecord record{
+          .timestamp = slot.timestamp.load(std::memory_order_relaxed),
+          .request_id = slot.request_id.load(std::memory_order_relaxed),
+          .value = slot.value.load(std::memory_order_relaxed),
+          .event = static_cast<trace::Event>(
+              slot.event.load(std::memory_order_relaxed)),
+          .thread_id = thread_id_};
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (slot.sequence.load(std::memory_order_relaxed) != sequence) {
+        continue;
+      }
+
+      records.push_back(record);
+    }
+  }
+
+private:
+  std::unique_ptr<Slot[]> slots_;
+  std::size_t capacity_;
+  uint64_t thread_id_;
+  std::atomic<uint64_t> head_{0};
+};
+
+std::atomic<bool> tracing_enabled{false};
+std::atomic<uint64_t> next_request_id{1};
+
+// Bumped by every start_tracing() call so that threads drop the buffers of the
+// previous session.
+std::atomic<uint64_t> tracing_generation{0};
+
+// Guards the registration of thread buffers, which happens once per thread and
+// tracing session, not once per event.
+std::mutex buffers_mutex;
+std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+std::size_t events_per_buffer = 0;
+uint64_t next_thread_id = 1;
+
+auto thread_buffer() -> ThreadBuffer * {
+  thread_local std::shared_ptr<ThreadBuffer> buffer;
+  thread_local uint64_t buffer_generation = 0;
+
+  uint64_t generation = tracing_generation.load(std::memory_order_acquire);
+  if (buffer == nullptr || buffer_generation != generation) {
+    std::lock_guard<std::mutex> lock{buffers_mutex};
+    buffer =
+        std::make_shared<ThreadBuffer>(events_per_buffer, next_thread_id++);
+    buffers.push_back(buffer);
+    buffer_generation = generation;
+  }
+  return buffer.get();
+}
+
+auto now() -> uint64_t {
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch())
+          .count());
+}
+
+auto random_id() -> uint64_t {
+  thread_local std::mt19937_64 generator{std::random_device{}()};
+  uint64_t id = 0;
+  while (id == 0) {
+    id = generator();
+  }
+  return id;
+}
+
+auto to_hex(uint64_t value) -> std::string {
+  char buffer[17];
+  std::snprintf(buffer, sizeof(buffer), "%016llx",
+                static_cast<unsigned long long>(value));
+  return buffer;
+}
+
+auto is_lower_hex(const std::string &value, std::size_t begin,
+                  std::size_t length) -> bool {
+  bool all_zeros = true;
+  for (std::size_t i = begin; i < begin + length; ++i) {
+    char c = value[i];
+    if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))) {
+      return false;
+    }
+    all_zeros = all_zeros && c == '0';
+  }
+  return !all_zeros;
+}
+
+// Validates a version 00 `traceparent` value:
+// "00-<32 hex trace id>-<16 hex parent id>-<2 hex flags>".
+auto is_valid_traceparent(const std::string &traceparent) -> bool {
+  return traceparent.size() == 55 && traceparent.compare(0, 3, "00-") == 0 &&
+         traceparent[35] == '-' && traceparent[52] == '-' &&
+         is_lower_hex(traceparent, 3, 32) &&
+         is_lower_hex(traceparent, 36, 16) &&
+         (is_lower_hex(traceparent, 53, 2) ||
+          traceparent.compare(53, 2, "00") == 0);
+}
+
+auto event_json(const EventRecord &record) -> std::string {
+  std::ostringstream json;
+  json << "{\"cat\":\"benoni\",\"pid\":1,\"tid\":" << record.thread_id
+       << ",\"ts\":" << record.timestamp / 1000 << '.'
+       << record.timestamp / 100 % 10 << record.timestamp / 10 % 10
+       << record.timestamp % 10 << ",\"id\":\"0x" << to_hex(record.request_id)
+       << "\",";
+  switch (record.event) {
+  case trace::Event::kEnqueue:
+    json << "\"name\":\"request\",\"ph\":\"b\",\"args\":{\"span_id\":\""
+         << to_hex(record.value) << "\"}";
+    break;
+  case trace::Event::kSend:
+    json << "\"name\":\"send\",\"ph\":\"n\"";
+    break;
+  case trace::Event::kHeaders:
+    json << "\"name\":\"headers\",\"ph\":\"n\",\"args\":{\"status\":"
+         << record.value << "}";
+    break;
+  case trace::Event::kBodyChunk:
+    json << "\"name\":\"body chunk\",\"ph\":\"n\",\"args\":{\"bytes\":"
+         << record.value << "}";
+    break;
+  case trace::Event::kComplete:
+    json << "\"name\":\"request\",\"ph\":\"e\",\"args\":{\"error\":"
+         << (record.value != 0 ? "true" : "false") << "}";
+    break;
+  case trace::Event::kCallbackBegin:
+    json << "\"name\":\"callback\",\"ph\":\"B\"";
+    break;
+  case trace::Event::kCallbackEnd:
+    json << "\"name\":\"callback\",\"ph\":\"E\"";
+    break;
+  }
+  json << "}";
+  return json.str();
+}
+
+} // namespace
+
+namespace trace {
+
+auto begin_request() -> uint64_t {
+  if (!tracing_enabled.load(std::memory_order_relaxed)) {
+    return 0;
+  }
+  return next_request_id.fetch_add(1, std::memory_order_relaxed);
+}
+
+auto record(Event event, uint64_t request_id, uint64_t value) -> void {
+  if (request_id == 0 || !tracing_enabled.load(std::memory_order_relaxed)) {
+    return;
+  }
+  thread_buffer()->push(event, request_id, value, now());
+}
+
+auto child_trace_context(const std::string *parent) -> TraceContext {
+  uint64_t span_id = random_id();
+  std::string traceparent;
+  if (parent != nullptr && is_valid_traceparent(*parent)) {
+    traceparent = parent->substr(0, 36) + to_hex(span_id) + parent->substr(52);
+  } else {
+    traceparent =
+        "00-" + to_hex(random_id()) + to_hex(random_id()) + "-" +
+        to_hex(span_id) + "-01";
+  }
+  return TraceContext{.traceparent = std::move(traceparent),
+                      .span_id = span_id};
+}
+
+} // namespace trace
+
+auto start_tracing(std::size_t events_per_thread) -> void {
+  std::lock_guard<std::mutex> lock{buffers_mutex};
+  buffers.clear();
+  events_per_buffer = events_per_thread > 0 ? events_per_thread : 1;
+  next_thread_id = 1;
+  tracing_generation.fetch_add(1, std::memory_order_release);
+  tracing_enabled.store(true, std::memory_order_release);
+}
+
+auto stop_tracing() -> void {
+  tracing_enabled.store(false, std::memory_order_release);
+}
+
+auto chrome_trace() -> std::string {
+  std::vector<EventRecord> records;
+  {
+    std::lock_guard<std::mutex> lock{buffers_mutex};
+    for (const auto &buffer : buffers) {
+      buffer->collect(records);
+    }
+  }
+
+  std::string json{"{\"displayTimeUnit\":\"ns\",\"traceEvents\":["};
+  for (std::size_t i = 0; i < records.size(); ++i) {
+    if (i > 0) {
+      json += ',';
+    }
+    json += event_json(records[i]);
+  }
+  json += "]}";
+  return json;
+}
+
+} // namespace benoni
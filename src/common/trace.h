@@ -0,0 +1,40 @@
+#ifndef BENONI_COMMON_TRACE_H_
+#define BENONI_COMMON_TRACE_H_
+
+#include <cstdint> // uint64_t
+#include <string>  // std::string
+
+namespace benoni::trace {
+
+enum class Event : uint8_t {
+  kEnqueue,
+  kSend,
+  kHeaders,
+  kBodyChunk,
+  kComplete,
+  kCallbackBegin,
+  kCallbackEnd,
+};
+
+// Returns a new non-zero id for a traced request, or 0 if tracing is not
+// active. Events recorded for the id 0 are dropped.
+auto begin_request() -> uint64_t;
+
+// Appends an event to the calling thread's ring buffer. The meaning of `value`
+// depends on the event: the span id for kEnqueue, the status code for
+// kHeaders, the number of bytes for kBodyChunk and 1 for a failed kComplete.
+auto record(Event event, uint64_t request_id, uint64_t value = 0) -> void;
+
+struct TraceContext {
+  std::string traceparent;
+  uint64_t span_id;
+};
+
+// Returns the `traceparent` header value for a new span. The span continues the
+// trace of `parent` if it is a valid `traceparent` value, otherwise it starts a
+// new trace.
+auto child_trace_context(const std::string *parent) -> TraceContext;
+
+} // namespace benoni::trace
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef BENONI_COMMON_URL_H_
+#define BENONI_COMMON_URL_H_
+
+#include <string>      // std::string
+#include <string_view> // std::string_view
+
+namespace benoni {
+
+// Returns the "host[:port]" part of `url`.
+inline auto host_of(const std::string &url) -> std::string_view {
+  std::string_view host{url};
+  std::size_t scheme_end = host.find("://");
+  if (scheme_end != std::string_view::npos) {
+    host.remove_prefix(scheme_end + 3);
+  }
+  return host.substr(0, host.find_first_of("/?#"));
+}
+
+} // namespace benoni
+
+#endif
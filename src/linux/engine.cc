@@ -0,0 +1,250 @@
+#include <benoni/http.h>
+
+#include "common/url.h"
+#include "session.h"
+
+#include <glib.h>
+
+#include <condition_variable> // std::condition_variable
+#include <deque>              // std::deque
+#include <functional>         // std::function, std::hash
+#include <memory>             // std::unique_ptr
+#include <mutex>              // std::mutex, std::lock_guard, std::unique_lock
+#include <string>             // std::string
+#include <string_view>        // std::string_view
+#include <thread>             // std::thread
+#include <variant>            // std::variant
+#include <vector>             // std::vector
+
+namespace benoni {
+namespace {
+
+auto resolve_thread_count(std::size_t threads) -> std::size_t {
+  if (threads > 0) {
+    return threads;
+  }
+  std::size_t hardware_threads = std::thread::hardware_concurrency();
+  return hardware_threads > 0 ? hardware_threads : 1;
+}
+
+// An I/O thread that runs its own main context. request() called from the
+// thread uses the sessions of that context.
+class Shard {
+public:
+  Shard()
+      : context_{g_main_context_new()},
+        loop_{g_main_loop_new(context_, FALSE)}, thread_{[this] { Run(); }} {}
+
+  ~Shard() {
+    // Quits from inside the loop, a g_main_loop_quit() that runs before
+    // g_main_loop_run() would be lost.
+    Post([this] { g_main_loop_quit(loop_); });
+    thread_.join();
+    release_sessions(context_);
+    g_main_loop_unref(loop_);
+    g_main_context_unref(context_);
+  }
+
+  auto Post(std::function<void()> task) -> void {
+    // An idle source always runs on the thread of the shard, unlike
+    // g_main_context_invoke(), which runs the task on the calling thread if the
+    // shard thread has not acquired the context yet.
+    GSource *source = g_idle_source_new();
+    g_source_set_callback(
+        source,
+        [](gpointer data) -> gboolean {
+          (*static_cast<std::function<void()> *>(data))();
+          return G_SOURCE_REMOVE;
+        },
+        new std::function<void()>{std::move(task)},
+        [](gpointer data) {
+          delete static_cast<std::function<void()> *>(data);
+        });
+    g_source_attach(source, context_);
+    g_source_unref(source);
+  }
+
+private:
+  auto Run() -> void {
+    g_main_context_push_thread_default(context_);
+    g_main_loop_run(loop_);
+    g_main_context_pop_thread_default(context_);
+  }
+
+  GMainContext *context_;
+  GMainLoop *loop_;
+  std::thread thread_;
+};
+
+// Runs callbacks on a fixed set of threads. Every thread owns a queue and
+// takes work from the front of it, and steals from the back of the other
+// queues once its own is empty.
+class CallbackPool {
+public:
+  explicit CallbackPool(std::size_t threads) {
+    for (std::size_t i = 0; i < threads; ++i) {
+      queues_.push_back(std::make_unique<Queue>());
+    }
+    for (std::size_t i = 0; i < threads; ++i) {
+      threads_.emplace_back([this, i] { Run(i); });
+    }
+  }
+
+  // Runs the remaining callbacks before returning.
+  ~CallbackPool() {
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      stopping_ = true;
+    }
+    wake_.notify_all();
+    for (auto &thread : threads_) {
+      thread.join();
+    }
+  }
+
+  auto Post(std::size_t hint, std::function<void()> task) -> void {
+    Queue &queue = *queues_[hint % queues_.size()];
+    {
+      std::lock_guard<std::mutex> lock{queue.mutex};
+      queue.tasks.push_back(std::move(task));
+    }
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      ++queued_;
+    }
+    wake_.notify_one();
+  }
+
+private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  auto Run(std::size_t index) -> void {
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock{mutex_};
+        wake_.wait(lock, [this] { return queued_ > 0 || stopping_; });
+        if (queued_ == 0) {
+          return;
+        }
+        // Claims one of the queued tasks, which is guaranteed to be in one of
+        // the queues.
+        --queued_;
+      }
+
+      std::function<void()> task;
+      while (!Take(index, task)) {
+        std::this_thread::yield();
+      }
+      task();
+    }
+  }
+
+  auto Take(std::size_t index, std::function<void()> &task) -> bool {
+    {
+      Queue &own = *queues_[index];
+      std::lock_guard<std::mutex> lock{own.mutex};
+      if (!own.tasks.empty()) {
+        task = std::move(own.tasks.front());
+        own.tasks.pop_front();
+        return true;
+      }
+    }
+
+    for (std::size_t i = 1; i < queues_.size(); ++i) {
+      Queue &victim = *queues_[(index + i) % queues_.size()];
+      std::lock_guard<std::mutex> lock{victim.mutex};
+      if (!victim.tasks.empty()) {
+        task = std::move(victim.tasks.back());
+        victim.tasks.pop_back();
+        return true;
+      }
+    }
+    return false;
+  }
+
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::vector<std::thread> threads_;
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::size_t queued_ = 0;
+  bool stopping_ = false;
+};
+
+} // namespace
+
+class Engine::Impl {
+public:
+  explicit Impl(const EngineOptions &options)
+      : callback_pool_{resolve_thread_count(options.callback_threads())} {
+    std::size_t io_threads = resolve_thread_count(options.io_threads());
+    for (std::size_t i = 0; i < io_threads; ++i) {
+      shards_.push_back(std::make_unique<Shard>());
+    }
+  }
+
+  ~Impl() {
+    std::unique_lock<std::mutex> lock{pending_mutex_};
+    idle_.wait(lock, [this] { return pending_ == 0; });
+  }
+
+  auto Request(const std::string &url, RequestOptions options,
+               std::function<void(std::variant<std::string, Response>)>
+                   callback) -> void {
+    {
+      std::lock_guard<std::mutex> lock{pending_mutex_};
+      ++pending_;
+    }
+
+    std::size_t shard =
+        std::hash<std::string_view>{}(host_of(url)) % shards_.size();
+    shards_[shard]->Post([this, shard, url, options = std::move(options),
+                          callback = std::move(callback)]() mutable {
+      benoni::request(
+          url, std::move(options),
+          [this, shard, callback = std::move(callback)](
+              std::variant<std::string, Response> result) mutable {
+            callback_pool_.Post(
+                shard, [this, callback = std::move(callback),
+                        result = std::move(result)]() mutable {
+                  callback(std::move(result));
+                  Done();
+                });
+          });
+    });
+  }
+
+private:
+  auto Done() -> void {
+    // Notifies while holding the lock, because the destructor may destroy the
+    // condition variable as soon as it observes that nothing is pending.
+    std::lock_guard<std::mutex> lock{pending_mutex_};
+    --pending_;
+    idle_.notify_all();
+  }
+
+  // Destroyed after the shards, so that no callback is posted to a destroyed
+  // pool.
+  CallbackPool callback_pool_;
+  std::vector<std::unique_ptr<Shard>> shards_;
+
+  std::mutex pending_mutex_;
+  std::condition_variable idle_;
+  std::size_t pending_ = 0;
+};
+
+Engine::Engine(EngineOptions options)
+    : impl_{std::make_unique<Impl>(options)} {}
+
+Engine::~Engine() = default;
+
+auto Engine::request(
+    const std::string &url, RequestOptions options,
+    std::function<void(std::variant<std::string, Response>)> callback) -> void {
+  impl_->Request(url, std::move(options), std::move(callback));
+}
+
+} // namespace benoni
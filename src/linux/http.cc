@@ -1,26 +1,204 @@
 #include <benoni/http.h>
 
+#include "common/concurrency.h"
+#include "common/replay.h"
+#include "common/trace.h"
+#include "session.h"
+
 #include <libsoup/soup.h>
 
-#include <array>   // std::array
-#include <cassert> // assert
-#include <map>     // std::map
-#include <sstream> // std::stringstream
-#include <string>  // std::string
-#include <variant> // std::variant
+#include <cassert>         // assert
+#include <chrono>          // std::chrono
+#include <cstdint>         // uint64_t
+#include <map>             // std::map
+#include <memory>          // std::shared_ptr, std::make_shared
+#include <memory_resource> // std::pmr::memory_resource, std::pmr::string
+#include <mutex>           // std::mutex, std::lock_guard
+#include <optional>        // std::optional
+#include <sstream>         // std::istringstream
+#include <string>          // std::string
+#include <thread>          // std::this_thread
+#include <variant>         // std::variant
+#include <vector>          // std::vector
 
 namespace benoni {
 namespace {
 
+auto method_name(Method method) -> const char * {
+  switch (method) {
+#define V(HTTP_METHOD)                                                         \
+  case Method::HTTP_METHOD:                                                    \
+    return #HTTP_METHOD;
+
+    BENONI_HTTP_METHODS(V)
+#undef V
+  }
+  return nullptr;
+}
+
+auto response_headers(SoupMessage *message,
+                      std::pmr::memory_resource *memory_resource)
+    -> ResponseHeaders {
+  ResponseHeaders headers{memory_resource};
+  soup_message_headers_foreach(
+      message->response_headers,
+      [](const char *name, const char *value, gpointer user_data) {
+        auto &headers_alias = *static_cast<ResponseHeaders *>(user_data);
+
+        // Splitting the header value by commas (common delimiter)
+        std::istringstream value_stream(value);
+        std::string single_value;
+        while (std::getline(value_stream, single_value, ',')) {
+          headers_alias.emplace(name, single_value);
+        }
+      },
+      &headers);
+  return headers;
+}
+
+// Creates the message of a request with its headers and body, or returns
+// nullptr if the url cannot be parsed. `expect_continue` is false when a
+// request that asked for it is resent without the expectation.
+auto new_message(const std::string &url,
+                 const std::shared_ptr<const RequestOptions> &options,
+                 bool expect_continue) -> SoupMessage * {
+  SoupMessage *message =
+      soup_message_new(method_name(options->method()), url.c_str());
+  if (message == nullptr) {
+    return nullptr;
+  }
+
+  for (const auto &[name, value] : options->headers()) {
+    soup_message_headers_append(message->request_headers, name.c_str(),
+                                value.c_str());
+  }
+
+  if (!options->body().empty()) {
+    // The body is sent from the options, which the buffer keeps alive, instead
+    // of a copy, since uploads can be large.
+    SoupBuffer *buffer = soup_buffer_new_with_owner(
+        options->body().data(), options->body().size(),
+        new std::shared_ptr<const RequestOptions>{options}, [](gpointer owner) {
+          delete static_cast<std::shared_ptr<const RequestOptions> *>(owner);
+        });
+    soup_message_body_append_buffer(message->request_body, buffer);
+    soup_buffer_free(buffer);
+
+    if (options->expect_continue()) {
+      // libsoup holds the body back until the server answers the headers with
+      // 100 Continue, and completes the message with any final response the
+      // server sends instead. Redirects are not followed, since following one
+      // would send the body to the new location before the caller sees it.
+      if (expect_continue) {
+        soup_message_headers_set_expectations(message->request_headers,
+                                              SOUP_EXPECTATION_CONTINUE);
+      }
+      soup_message_set_flags(message, soup_message_get_flags(message) |
+                                          SOUP_MESSAGE_NO_REDIRECT);
+    }
+  }
+  return message;
+}
+
+// A traced request: its trace id, or 0 if tracing is not active, and the
+// `traceparent` header of its span.
+struct Trace {
+  uint64_t id = 0;
+  std::string traceparent;
+};
+
+// Starts tracing a request if tracing is active and records that it was
+// enqueued, before it waits for the concurrency limiter.
+auto begin_trace(const RequestOptions &options) -> Trace {
+  uint64_t trace_id = trace::begin_request();
+  if (trace_id == 0) {
+    return {};
+  }
+
+  // Header names are case-insensitive, so `Traceparent` is a parent too.
+  const std::string *parent = nullptr;
+  for (const auto &[name, value] : options.headers()) {
+    if (g_ascii_strcasecmp(name.c_str(), "traceparent") == 0) {
+      parent = &value;
+      break;
+    }
+  }
+  trace::TraceContext trace_context = trace::child_trace_context(parent);
+  trace::record(trace::Event::kEnqueue, trace_id, trace_context.span_id);
+  return Trace{.id = trace_id,
+               .traceparent = std::move(trace_context.traceparent)};
+}
+
+// Records that a traced request completed and calls its callback.
+auto finish(uint64_t trace_id,
+            const std::function<void(std::variant<std::string, Response>)>
+                &callback,
+            std::variant<std::string, Response> result) -> void {
+  trace::record(trace::Event::kComplete, trace_id,
+                std::holds_alternative<std::string>(result) ? 1 : 0);
+  trace::record(trace::Event::kCallbackBegin, trace_id);
+  callback(std::move(result));
+  trace::record(trace::Event::kCallbackEnd, trace_id);
+}
+
+// Size by which the response body grows for every read.
+constexpr gsize kReadChunkSize = 16384;
+
+// How long a request sent with Expect: 100-continue waits for the server to
+// answer its headers, counted from when they were written, before it is resent
+// without the expectation, for servers and proxies that ignore it. Matches the
+// default of curl.
+constexpr guint kExpectContinueTimeoutMs = 1000;
+
 struct AsyncHttpContext {
+  std::string url;
+  std::shared_ptr<const RequestOptions> options;
   SoupMessage *message;
-  std::array<uint8_t, 2048> buffer;
-  std::stringstream response;
+  // Allocated from the memory resource of the request. The body is read
+  // straight into it, kReadChunkSize bytes at a time.
+  std::pmr::string body;
   std::function<void(std::variant<std::string, Response>)> callback;
+  uint64_t trace_id;
+
+  // Set while a request sent with Expect: 100-continue waits for the server
+  // to answer its headers.
+  GCancellable *cancellable = nullptr;
+  GSource *expect_timeout = nullptr;
+  bool expect_timed_out = false;
+
+  ~AsyncHttpContext() {
+    StopExpectTimeout();
+    if (cancellable != nullptr) {
+      g_object_unref(cancellable);
+    }
+    g_signal_handlers_disconnect_by_data(message, this);
+    g_object_unref(message);
+  }
 
-  ~AsyncHttpContext() { g_object_unref(message); }
+  auto StopExpectTimeout() -> void {
+    if (expect_timeout == nullptr) {
+      return;
+    }
+    g_source_destroy(expect_timeout);
+    g_source_unref(expect_timeout);
+    expect_timeout = nullptr;
+  }
 };
 
+auto complete(AsyncHttpContext *async_http_context,
+              std::variant<std::string, Response> result) -> void {
+  auto callback = std::move(async_http_context->callback);
+  uint64_t trace_id = async_http_context->trace_id;
+  delete async_http_context;
+  finish(trace_id, callback, std::move(result));
+}
+
+auto message_wrote_headers_callback(SoupMessage * /* message */, gpointer data)
+    -> void {
+  auto async_http_context = static_cast<AsyncHttpContext *>(data);
+  trace::record(trace::Event::kSend, async_http_context->trace_id);
+}
+
 auto stream_close_callback(GObject *source_object, GAsyncResult *res,
                            gpointer data) -> void {
   GInputStream *stream = G_INPUT_STREAM(source_object);
@@ -31,37 +209,34 @@ auto stream_close_callback(GObject *source_object, GAsyncResult *res,
   if (stream_closed == FALSE) {
     assert(error);
     g_object_unref(stream);
-    auto callback = std::move(async_http_context->callback);
-    delete async_http_context;
-    callback(error->message);
+    complete(async_http_context, error->message);
     return;
   }
 
   g_object_unref(stream);
 
-  std::multimap<std::string, std::string> headers;
-  soup_message_headers_foreach(
-      async_http_context->message->response_headers,
-      [](const char *name, const char *value, gpointer user_data) {
-        auto &headers_alias =
-            *static_cast<std::map<std::string, std::string> *>(user_data);
-
-        // Splitting the header value by commas (common delimiter)
-        std::istringstream value_stream(value);
-        std::string single_value;
-        while (std::getline(value_stream, single_value, ',')) {
-          headers_alias.emplace(name, single_value);
-        }
-      },
-      &headers);
-
+  std::pmr::memory_resource *memory_resource =
+      async_http_context->body.get_allocator().resource();
   Response response{
-      .body = async_http_context->response.str(),
+      .body = std::move(async_http_context->body),
       .status = static_cast<uint16_t>(async_http_context->message->status_code),
-      .headers = std::move(headers)};
-  auto callback = std::move(async_http_context->callback);
-  delete async_http_context;
-  callback(std::move(response));
+      .headers =
+          response_headers(async_http_context->message, memory_resource)};
+  complete(async_http_context, std::move(response));
+}
+
+auto stream_read_callback(GObject *source_object, GAsyncResult *res,
+                          gpointer data) -> void;
+
+// Grows the body by kReadChunkSize bytes and reads the next chunk into them.
+auto read_next_chunk(GInputStream *stream, AsyncHttpContext *async_http_context)
+    -> void {
+  std::pmr::string &body = async_http_context->body;
+  std::size_t size = body.size();
+  body.resize(size + kReadChunkSize);
+  g_input_stream_read_async(stream, body.data() + size, kReadChunkSize,
+                            G_PRIORITY_DEFAULT, nullptr, stream_read_callback,
+                            async_http_context);
 }
 
 auto stream_read_callback(GObject *source_object, GAsyncResult *res,
@@ -71,15 +246,18 @@ auto stream_read_callback(GObject *source_object, GAsyncResult *res,
 
   GError *error = nullptr;
   gssize bytes_read = g_input_stream_read_finish(stream, res, &error);
+  std::pmr::string &body = async_http_context->body;
   if (bytes_read == -1) {
     assert(error);
     g_object_unref(stream);
-    auto callback = std::move(async_http_context->callback);
-    delete async_http_context;
-    callback(error->message);
+    complete(async_http_context, error->message);
     return;
   }
 
+  // Drops the part of the chunk that was not filled.
+  body.resize(body.size() - kReadChunkSize +
+              static_cast<std::size_t>(bytes_read));
+
   if (bytes_read == 0) {
     // end
     g_input_stream_close_async(stream, G_PRIORITY_DEFAULT, nullptr,
@@ -88,16 +266,104 @@ auto stream_read_callback(GObject *source_object, GAsyncResult *res,
   }
 
   assert(bytes_read > 0);
+  trace::record(trace::Event::kBodyChunk, async_http_context->trace_id,
+                static_cast<uint64_t>(bytes_read));
+
+  read_next_chunk(stream, async_http_context);
+}
+
+auto message_got_response_callback(SoupMessage * /* message */,
+                                   gpointer data) -> void {
+  auto async_http_context = static_cast<AsyncHttpContext *>(data);
+  async_http_context->StopExpectTimeout();
+}
+
+// Cancels a request whose server did not answer its headers in time, so that
+// session_send_callback() resends it without the expectation.
+auto expect_timeout_callback(gpointer data) -> gboolean {
+  auto async_http_context = static_cast<AsyncHttpContext *>(data);
+  g_source_unref(async_http_context->expect_timeout);
+  async_http_context->expect_timeout = nullptr;
+  async_http_context->expect_timed_out = true;
+  g_cancellable_cancel(async_http_context->cancellable);
+  return G_SOURCE_REMOVE;
+}
+
+// Arms the timeout of a request sent with Expect: 100-continue once its
+// headers are written, so that connecting, the TLS handshake and waiting for a
+// free connection do not count towards it. Any interim or final response from
+// the server stops it.
+auto message_wrote_expectation_callback(SoupMessage * /* message */,
+                                        gpointer data) -> void {
+  auto async_http_context = static_cast<AsyncHttpContext *>(data);
+  async_http_context->StopExpectTimeout();
+  async_http_context->expect_timeout =
+      g_timeout_source_new(kExpectContinueTimeoutMs);
+  g_source_set_callback(async_http_context->expect_timeout,
+                        expect_timeout_callback, async_http_context, nullptr);
+  g_source_attach(async_http_context->expect_timeout,
+                  g_main_context_get_thread_default());
+}
 
-  for (gssize i = 0; i < bytes_read; ++i) {
-    async_http_context->response
-        << async_http_context->buffer[static_cast<std::size_t>(i)];
+auto wait_for_continue(AsyncHttpContext *async_http_context) -> void {
+  async_http_context->cancellable = g_cancellable_new();
+  g_signal_connect(async_http_context->message, "wrote-headers",
+                   G_CALLBACK(message_wrote_expectation_callback),
+                   async_http_context);
+  g_signal_connect(async_http_context->message, "got-informational",
+                   G_CALLBACK(message_got_response_callback),
+                   async_http_context);
+  g_signal_connect(async_http_context->message, "got-headers",
+                   G_CALLBACK(message_got_response_callback),
+                   async_http_context);
+}
+
+auto session_send_callback(GObject *object, GAsyncResult *result,
+                           gpointer data) -> void;
+
+auto send_message(SoupSession *session, AsyncHttpContext *async_http_context)
+    -> void {
+  SoupMessage *message = async_http_context->message;
+  if (async_http_context->trace_id != 0) {
+    g_signal_connect(message, "wrote-headers",
+                     G_CALLBACK(message_wrote_headers_callback),
+                     async_http_context);
+  }
+  if (soup_message_headers_get_expectations(message->request_headers) &
+      SOUP_EXPECTATION_CONTINUE) {
+    wait_for_continue(async_http_context);
   }
+  soup_session_send_async(session, message, async_http_context->cancellable,
+                          session_send_callback, async_http_context);
+}
 
-  g_input_stream_read_async(stream, async_http_context->buffer.data(),
-                            async_http_context->buffer.max_size(),
-                            G_PRIORITY_DEFAULT, nullptr, stream_read_callback,
-                            async_http_context);
+// Sends a request whose server ignored Expect: 100-continue again, this time
+// without the expectation, as part of the same trace span.
+auto resend_without_expectation(AsyncHttpContext *async_http_context) -> void {
+  SoupMessage *message = new_message(async_http_context->url,
+                                     async_http_context->options, false);
+  assert(message != nullptr);
+  auto session = prepare_session(message, async_http_context->options->tls());
+  if (std::holds_alternative<std::string>(session)) {
+    g_object_unref(message);
+    complete(async_http_context, std::get<std::string>(std::move(session)));
+    return;
+  }
+
+  SoupMessage *previous_message = async_http_context->message;
+  const char *traceparent = soup_message_headers_get_one(
+      previous_message->request_headers, "traceparent");
+  if (traceparent != nullptr) {
+    soup_message_headers_replace(message->request_headers, "traceparent",
+                                 traceparent);
+  }
+  g_signal_handlers_disconnect_by_data(previous_message, async_http_context);
+  g_object_unref(previous_message);
+  async_http_context->message = message;
+
+  g_clear_object(&async_http_context->cancellable);
+  async_http_context->expect_timed_out = false;
+  send_message(std::get<SoupSession *>(session), async_http_context);
 }
 
 auto session_send_callback(GObject *object, GAsyncResult *result,
@@ -107,49 +373,272 @@ auto session_send_callback(GObject *object, GAsyncResult *result,
   GError *error = nullptr;
   GInputStream *stream =
       soup_session_send_finish(SOUP_SESSION(object), result, &error);
+  if (!stream && async_http_context->expect_timed_out) {
+    g_error_free(error);
+    resend_without_expectation(async_http_context);
+    return;
+  }
   if (!stream) {
     assert(error);
-    auto callback = std::move(async_http_context->callback);
-    delete async_http_context;
-    callback(error->message);
+    const char *tls_error_message = tls_error(async_http_context->message);
+    complete(async_http_context, tls_error_message != nullptr
+                                     ? tls_error_message
+                                     : error->message);
     return;
   }
 
-  g_input_stream_read_async(stream, async_http_context->buffer.data(),
-                            async_http_context->buffer.max_size(),
-                            G_PRIORITY_DEFAULT, nullptr, stream_read_callback,
-                            async_http_context);
+  count_connection_reuse(async_http_context->message);
+
+  trace::record(trace::Event::kHeaders, async_http_context->trace_id,
+                async_http_context->message->status_code);
+
+  read_next_chunk(stream, async_http_context);
+}
+
+// Calls `task` from `context` once `delay` has passed.
+auto run_after(GMainContext *context, std::chrono::nanoseconds delay,
+               std::function<void()> task) -> void {
+  auto delay_ms = std::chrono::ceil<std::chrono::milliseconds>(delay).count();
+  GSource *source = delay_ms > 0
+                        ? g_timeout_source_new(static_cast<guint>(delay_ms))
+                        : g_idle_source_new();
+  g_source_set_callback(
+      source,
+      [](gpointer data) -> gboolean {
+        (*static_cast<std::function<void()> *>(data))();
+        return G_SOURCE_REMOVE;
+      },
+      new std::function<void()>{std::move(task)},
+      [](gpointer data) { delete static_cast<std::function<void()> *>(data); });
+  g_source_attach(source, context);
+  g_source_unref(source);
+}
+
+// Returns a reference to the thread-default main context of the calling
+// thread, which requests from the thread use.
+auto thread_default_context() -> std::shared_ptr<GMainContext> {
+  return {g_main_context_ref_thread_default(), g_main_context_unref};
+}
+
+// A coalesced request that is waiting for an identical request which is
+// already in flight.
+struct Waiter {
+  // Receives a copy of the response allocated from this resource.
+  std::pmr::memory_resource *memory_resource;
+  // The callback runs on the main context the request was made from, which
+  // need not be the one of the request it waits for.
+  std::shared_ptr<GMainContext> context;
+  std::function<void(std::variant<std::string, Response>)> callback;
+};
+
+// Waiters keyed by coalescing_key().
+std::mutex in_flight_mutex;
+std::map<std::string, std::vector<Waiter>> in_flight_requests;
+
+auto coalescing_key(const char *method, const std::string &url,
+                    const RequestOptions &options) -> std::string {
+  std::string key{method};
+  key += ' ';
+  key += url;
+  // Requests with different TLS options trust and present different
+  // certificates, so they must not share a response.
+  key += '\0';
+  key += tls_key(options.tls());
+  for (const auto &[name, value] : options.headers()) {
+    key += '\n';
+    key += name;
+    key += ": ";
+    key += value;
+  }
+  // The body is sent as well, even though a GET or HEAD request rarely has
+  // one.
+  key += '\0';
+  key += options.body();
+  return key;
+}
+
+// Calls `callback` with the replayed result from the thread-default main
+// context once the replayed delay has passed.
+auto deliver_replayed(
+    replay::Replayed replayed,
+    std::function<void(std::variant<std::string, Response>)> callback) -> void {
+  run_after(g_main_context_get_thread_default(), replayed.delay,
+            [result = std::move(replayed.result),
+             callback = std::move(callback)]() mutable {
+              callback(std::move(result));
+            });
+}
+
+// Sends a request that the concurrency limiter let through.
+auto send_request(
+    const std::string &url, RequestOptions options, Trace trace,
+    std::function<void(std::variant<std::string, Response>)> callback) -> void {
+  callback = replay::record_callback(url, options, std::move(callback));
+
+  auto shared_options =
+      std::make_shared<const RequestOptions>(std::move(options));
+  SoupMessage *message = new_message(url, shared_options, true);
+  if (message == nullptr) {
+    finish(trace.id, callback, "The uri could not be parsed");
+    return;
+  }
+
+  auto session = prepare_session(message, shared_options->tls());
+  if (std::holds_alternative<std::string>(session)) {
+    g_object_unref(message);
+    finish(trace.id, callback, std::get<std::string>(std::move(session)));
+    return;
+  }
+
+  if (trace.id != 0) {
+    soup_message_headers_replace(message->request_headers, "traceparent",
+                                 trace.traceparent.c_str());
+  }
+
+  auto async_http_context = new AsyncHttpContext{
+      .url = url,
+      .options = shared_options,
+      .message = message,
+      .body = std::pmr::string{shared_options->memory_resource()},
+      .callback = std::move(callback),
+      .trace_id = trace.id};
+  send_message(std::get<SoupSession *>(session), async_http_context);
 }
 
+// Owns the main context that request_sync() pushes as the thread-default
+// context of its thread and iterates until its request completes, which gives
+// each thread its own sessions.
+class SyncContext {
+public:
+  SyncContext() : context_{g_main_context_new()} {}
+
+  ~SyncContext() {
+    release_sessions(context_);
+    g_main_context_unref(context_);
+  }
+
+  auto Get() -> GMainContext * { return context_; }
+
+private:
+  GMainContext *context_;
+};
+
 } // namespace
 
 auto request(const std::string &url, RequestOptions options,
              std::function<void(std::variant<std::string, Response>)> callback)
     -> void {
-  const char *method = nullptr;
-  switch (options.method()) {
-#define V(HTTP_METHOD)                                                         \
-  case Method::HTTP_METHOD:                                                    \
-    method = #HTTP_METHOD;                                                     \
-    break;
+  if (auto replayed = replay::find(url, options)) {
+    deliver_replayed(std::move(replayed.value()), std::move(callback));
+    return;
+  }
 
-    BENONI_HTTP_METHODS(V)
-#undef V
+  const char *method = method_name(options.method());
+
+  if (options.coalesce() &&
+      (options.method() == Method::GET || options.method() == Method::HEAD)) {
+    std::string key = coalescing_key(method, url, options);
+    {
+      std::lock_guard<std::mutex> lock{in_flight_mutex};
+      auto [waiters, inserted] = in_flight_requests.try_emplace(key);
+      if (!inserted) {
+        waiters->second.push_back(
+            Waiter{.memory_resource = options.memory_resource(),
+                   .context = thread_default_context(),
+                   .callback = std::move(callback)});
+        return;
+      }
+    }
+
+    callback = [key = std::move(key), callback = std::move(callback)](
+                   std::variant<std::string, Response> result) {
+      std::vector<Waiter> waiters;
+      {
+        std::lock_guard<std::mutex> lock{in_flight_mutex};
+        waiters = std::move(in_flight_requests.extract(key).mapped());
+      }
+
+      for (auto &waiter : waiters) {
+        // Copies the response into the memory resource of the waiter instead
+        // of the default one.
+        std::variant<std::string, Response> copy{std::string{}};
+        if (const Response *response = std::get_if<Response>(&result)) {
+          copy = Response{
+              .body = std::pmr::string{response->body, waiter.memory_resource},
+              .status = response->status,
+              .headers =
+                  ResponseHeaders{response->headers, waiter.memory_resource}};
+        } else {
+          copy = std::get<std::string>(result);
+        }
+
+        if (g_main_context_is_owner(waiter.context.get())) {
+          waiter.callback(std::move(copy));
+          continue;
+        }
+        run_after(waiter.context.get(), std::chrono::nanoseconds::zero(),
+                  [callback = std::move(waiter.callback),
+                   copy = std::move(copy)]() mutable {
+                    callback(std::move(copy));
+                  });
+      }
+      callback(std::move(result));
+    };
   }
-  SoupMessage *message = soup_message_new(method, url.c_str());
-  if (message == nullptr) {
-    callback("The uri could not be parsed");
-    return;
+
+  // The time spent waiting for the limiter is part of the trace.
+  Trace trace = begin_trace(options);
+  uint64_t trace_id = trace.id;
+  auto sent = std::make_shared<bool>(false);
+  concurrency::dispatch(
+      url,
+      [trace_id, sent, callback = std::move(callback)](
+          std::variant<std::string, Response> result) {
+        if (*sent) {
+          callback(std::move(result));
+          return;
+        }
+        // send_request() records the completion of the requests it sends,
+        // the limiter rejected this one.
+        finish(trace_id, callback, std::move(result));
+      },
+      [url, options = std::move(options), trace = std::move(trace),
+       sent](std::function<void(std::variant<std::string, Response>)>
+                 callback) mutable {
+        *sent = true;
+        send_request(url, std::move(options), std::move(trace),
+                     std::move(callback));
+      },
+      // Runs the timeout, and the start of a queued request, on the main
+      // context the request was made from.
+      [context = thread_default_context()](std::chrono::milliseconds delay,
+                                           std::function<void()> task) {
+        run_after(context.get(), delay, std::move(task));
+      });
+}
+
+auto request_sync(const std::string &url, RequestOptions options)
+    -> std::variant<std::string, Response> {
+  if (auto replayed = replay::find(url, options)) {
+    std::this_thread::sleep_for(replayed->delay);
+    return std::move(replayed->result);
   }
 
-  SoupSession *session = soup_session_new_with_options(SOUP_SESSION_USER_AGENT,
-                                                       "Benoni/1.0", nullptr);
-  auto async_http_context = new AsyncHttpContext{};
-  async_http_context->message = message;
-  async_http_context->callback = std::move(callback);
-  soup_session_send_async(session, async_http_context->message,
-                          G_PRIORITY_DEFAULT, session_send_callback,
-                          async_http_context);
+  thread_local SyncContext sync_context;
+  g_main_context_push_thread_default(sync_context.Get());
+
+  std::optional<std::variant<std::string, Response>> result;
+  Trace trace = begin_trace(options);
+  send_request(url, std::move(options), std::move(trace),
+               [&result](std::variant<std::string, Response> response) {
+                 result = std::move(response);
+               });
+  while (!result.has_value()) {
+    g_main_context_iteration(sync_context.Get(), TRUE);
+  }
+
+  g_main_context_pop_thread_default(sync_context.Get());
+  return std::move(result.value());
 }
 
 } // namespace benoni
@@ -0,0 +1,319 @@
+#include "session.h"
+
+#include <atomic>  // std::atomic
+#include <cstdint> // uint64_t
+#include <map>     // std::map
+#include <memory>  // std::shared_ptr, std::unique_ptr
+#include <mutex>   // std::mutex, std::lock_guard
+#include <string>  // std::string
+#include <utility> // std::pair
+#include <variant> // std::variant
+#include <vector>  // std::vector
+
+namespace benoni {
+namespace {
+
+constexpr const char *kTlsErrorKey = "benoni-tls-error";
+constexpr const char *kTlsHandshakeKey = "benoni-tls-handshake";
+
+// Connection limits of every session. A session is shared by all requests
+// from one main context, so libsoup's defaults of 10 connections and 2 per
+// host would queue concurrent requests to a host behind 2 connections.
+constexpr int kMaxConnections = 256;
+constexpr int kMaxConnectionsPerHost = 64;
+
+std::atomic<uint64_t> handshakes{0};
+std::atomic<uint64_t> reused_connections{0};
+
+// The certificates loaded for one set of TLS options.
+struct TlsProfile {
+  GTlsDatabase *database = nullptr;
+  GTlsCertificate *certificate = nullptr;
+  std::optional<TlsVersion> minimum_version;
+
+  TlsProfile() = default;
+  TlsProfile(const TlsProfile &) = delete;
+  TlsProfile &operator=(const TlsProfile &) = delete;
+
+  ~TlsProfile() {
+    if (database != nullptr) {
+      g_object_unref(database);
+    }
+    if (certificate != nullptr) {
+      g_object_unref(certificate);
+    }
+  }
+};
+
+struct SharedSession {
+  SharedSession(SoupSession *session,
+                std::shared_ptr<const TlsProfile> profile, uint64_t generation)
+      : session{session}, profile{std::move(profile)}, generation{generation} {}
+
+  SharedSession(const SharedSession &) = delete;
+  SharedSession &operator=(const SharedSession &) = delete;
+
+  ~SharedSession() { g_object_unref(session); }
+
+  SoupSession *session;
+  std::shared_ptr<const TlsProfile> profile;
+  // The value of `tls_generation` when the profile was loaded.
+  uint64_t generation;
+};
+
+// What the network-event handler of a message uses. The session outlives the
+// events of the messages it sends, but the profile may be replaced before.
+struct MessageSession {
+  SoupSession *session;
+  std::shared_ptr<const TlsProfile> profile;
+};
+
+// Profiles are keyed by tls_key() and sessions by the main context they are
+// used from as well. Both live until the process exits, or until the next
+// request after reload_tls_files() for TLS options that have files.
+// Messages in flight keep the profile they were sent with.
+std::mutex sessions_mutex;
+std::map<std::string, std::shared_ptr<const TlsProfile>> profiles;
+std::map<std::pair<GMainContext *, std::string>, std::unique_ptr<SharedSession>>
+    sessions;
+uint64_t tls_generation = 0;
+
+auto load_profile(const std::optional<TlsOptions> &tls)
+    -> std::variant<std::string, std::shared_ptr<const TlsProfile>> {
+  auto profile = std::make_shared<TlsProfile>();
+  if (!tls.has_value()) {
+    return profile;
+  }
+
+  profile->minimum_version = tls->minimum_version();
+
+  GError *error = nullptr;
+  if (!tls->ca_file().empty()) {
+    profile->database =
+        g_tls_file_database_new(tls->ca_file().c_str(), &error);
+    if (profile->database == nullptr) {
+      std::string message{error->message};
+      g_error_free(error);
+      return message;
+    }
+  }
+
+  if (!tls->certificate_file().empty()) {
+    profile->certificate = g_tls_certificate_new_from_files(
+        tls->certificate_file().c_str(), tls->private_key_file().c_str(),
+        &error);
+    if (profile->certificate == nullptr) {
+      std::string message{error->message};
+      g_error_free(error);
+      return message;
+    }
+  }
+
+  return profile;
+}
+
+// Whether the profile for `tls` reads any file, which reload_tls_files() has
+// to read again.
+auto has_files(const std::optional<TlsOptions> &tls) -> bool {
+  return tls.has_value() &&
+         (!tls->ca_file().empty() || !tls->certificate_file().empty());
+}
+
+auto to_protocol_version(TlsVersion version) -> GTlsProtocolVersion {
+  switch (version) {
+  case TlsVersion::TLS_1_0:
+    return G_TLS_PROTOCOL_VERSION_TLS_1_0;
+  case TlsVersion::TLS_1_1:
+    return G_TLS_PROTOCOL_VERSION_TLS_1_1;
+  case TlsVersion::TLS_1_2:
+    return G_TLS_PROTOCOL_VERSION_TLS_1_2;
+  case TlsVersion::TLS_1_3:
+    return G_TLS_PROTOCOL_VERSION_TLS_1_3;
+  }
+  return G_TLS_PROTOCOL_VERSION_UNKNOWN;
+}
+
+auto message_network_event_callback(SoupMessage *message,
+                                    GSocketClientEvent event,
+                                    GIOStream *connection, gpointer data)
+    -> void {
+  auto message_session = static_cast<const MessageSession *>(data);
+  const TlsProfile *profile = message_session->profile.get();
+
+  switch (event) {
+  case G_SOCKET_CLIENT_TLS_HANDSHAKING:
+    g_object_set_data(G_OBJECT(message), kTlsHandshakeKey, GINT_TO_POINTER(1));
+    if (profile->certificate != nullptr) {
+      g_tls_connection_set_certificate(G_TLS_CONNECTION(connection),
+                                       profile->certificate);
+    }
+    return;
+  case G_SOCKET_CLIENT_TLS_HANDSHAKED: {
+    handshakes.fetch_add(1, std::memory_order_relaxed);
+    if (!profile->minimum_version.has_value()) {
+      return;
+    }
+
+    GTlsProtocolVersion version =
+        g_tls_connection_get_protocol_version(G_TLS_CONNECTION(connection));
+    if (version != G_TLS_PROTOCOL_VERSION_UNKNOWN &&
+        version >= to_protocol_version(profile->minimum_version.value())) {
+      return;
+    }
+
+    g_object_set_data_full(
+        G_OBJECT(message), kTlsErrorKey,
+        g_strdup("The negotiated TLS version is below the minimum version"),
+        g_free);
+    soup_session_cancel_message(message_session->session, message,
+                                SOUP_STATUS_SSL_FAILED);
+    return;
+  }
+  default:
+    return;
+  }
+}
+
+auto configure_session(SoupSession *session, SessionKind kind) -> void {
+  switch (kind) {
+  case SessionKind::kHttp:
+    return;
+  case SessionKind::kWebSocket:
+    soup_session_remove_feature_by_type(session,
+                                        SOUP_TYPE_WEBSOCKET_EXTENSION_DEFLATE);
+    return;
+  case SessionKind::kWebSocketDeflate:
+    // Removes the extension first, so that it is only offered once whether or
+    // not the session came with it.
+    soup_session_remove_feature_by_type(session,
+                                        SOUP_TYPE_WEBSOCKET_EXTENSION_DEFLATE);
+    if (!soup_session_has_feature(session,
+                                  SOUP_TYPE_WEBSOCKET_EXTENSION_MANAGER)) {
+      soup_session_add_feature_by_type(session,
+                                       SOUP_TYPE_WEBSOCKET_EXTENSION_MANAGER);
+    }
+    soup_session_add_feature_by_type(session,
+                                     SOUP_TYPE_WEBSOCKET_EXTENSION_DEFLATE);
+    return;
+  }
+}
+
+} // namespace
+
+auto tls_key(const std::optional<TlsOptions> &tls) -> std::string {
+  if (!tls.has_value()) {
+    return {};
+  }
+
+  std::string key{tls->ca_file()};
+  key += '\0';
+  key += tls->certificate_file();
+  key += '\0';
+  key += tls->private_key_file();
+  key += '\0';
+  if (tls->minimum_version().has_value()) {
+    key += std::to_string(static_cast<int>(tls->minimum_version().value()));
+  }
+  return key;
+}
+
+auto prepare_session(SoupMessage *message,
+                     const std::optional<TlsOptions> &tls, SessionKind kind)
+    -> std::variant<std::string, SoupSession *> {
+  std::string key = tls_key(tls);
+  std::string session_key = key;
+  session_key += '\0';
+  session_key += std::to_string(static_cast<int>(kind));
+  MessageSession *message_session = nullptr;
+  // Released after the lock, a session unreffed here may dispose of its
+  // connections.
+  std::unique_ptr<SharedSession> outdated_session;
+  {
+    std::lock_guard<std::mutex> lock{sessions_mutex};
+    auto [session, inserted] = sessions.try_emplace(
+        std::pair{g_main_context_get_thread_default(), session_key});
+    if (!inserted && has_files(tls) &&
+        session->second->generation != tls_generation) {
+      outdated_session = std::move(session->second);
+    }
+    if (session->second == nullptr) {
+      auto profile = profiles.find(key);
+      if (profile == profiles.end()) {
+        auto loaded_profile = load_profile(tls);
+        if (std::holds_alternative<std::string>(loaded_profile)) {
+          sessions.erase(session);
+          return std::get<std::string>(std::move(loaded_profile));
+        }
+        profile = profiles
+                      .emplace(key, std::get<std::shared_ptr<const TlsProfile>>(
+                                        std::move(loaded_profile)))
+                      .first;
+      }
+
+      SoupSession *soup_session = soup_session_new_with_options(
+          SOUP_SESSION_USER_AGENT, "Benoni/1.0", SOUP_SESSION_MAX_CONNS,
+          kMaxConnections, SOUP_SESSION_MAX_CONNS_PER_HOST,
+          kMaxConnectionsPerHost, nullptr);
+      if (profile->second->database != nullptr) {
+        g_object_set(soup_session, SOUP_SESSION_TLS_DATABASE,
+                     profile->second->database, nullptr);
+      }
+      configure_session(soup_session, kind);
+      session->second = std::make_unique<SharedSession>(
+          soup_session, profile->second, tls_generation);
+    }
+    message_session = new MessageSession{.session = session->second->session,
+                                         .profile = session->second->profile};
+  }
+
+  g_signal_connect_data(
+      message, "network-event", G_CALLBACK(message_network_event_callback),
+      message_session,
+      [](gpointer data, GClosure * /* closure */) {
+        delete static_cast<MessageSession *>(data);
+      },
+      static_cast<GConnectFlags>(0));
+  return message_session->session;
+}
+
+auto release_sessions(GMainContext *context) -> void {
+  std::vector<std::unique_ptr<SharedSession>> released;
+  {
+    std::lock_guard<std::mutex> lock{sessions_mutex};
+    auto session = sessions.lower_bound(std::pair{context, std::string{}});
+    while (session != sessions.end() && session->first.first == context) {
+      released.push_back(std::move(session->second));
+      session = sessions.erase(session);
+    }
+  }
+}
+
+auto tls_error(SoupMessage *message) -> const char * {
+  return static_cast<const char *>(
+      g_object_get_data(G_OBJECT(message), kTlsErrorKey));
+}
+
+auto count_connection_reuse(SoupMessage *message) -> void {
+  SoupURI *uri = soup_message_get_uri(message);
+  if (uri->scheme != SOUP_URI_SCHEME_HTTPS ||
+      g_object_get_data(G_OBJECT(message), kTlsHandshakeKey) != nullptr) {
+    return;
+  }
+  reused_connections.fetch_add(1, std::memory_order_relaxed);
+}
+
+auto reload_tls_files() -> void {
+  std::lock_guard<std::mutex> lock{sessions_mutex};
+  // Sessions hold on to their profiles until they are replaced.
+  profiles.clear();
+  ++tls_generation;
+}
+
+auto tls_stats() -> TlsStats {
+  return TlsStats{
+      .handshakes = handshakes.load(std::memory_order_relaxed),
+      .reused_connections = reused_connections.load(std::memory_order_relaxed),
+  };
+}
+
+} // namespace benoni
@@ -0,0 +1,49 @@
+#ifndef BENONI_LINUX_SESSION_H_
+#define BENONI_LINUX_SESSION_H_
+
+#include <benoni/http.h>
+
+#include <libsoup/soup.h>
+
+#include <optional> // std::optional
+#include <string>   // std::string
+#include <variant>  // std::variant
+
+namespace benoni {
+
+// Sessions are configured differently for plain HTTP requests and for
+// WebSocket connections with and without the permessage-deflate extension.
+enum class SessionKind {
+  kHttp,
+  kWebSocket,
+  kWebSocketDeflate,
+};
+
+// Returns a key that is equal for equal TLS options and differs otherwise.
+auto tls_key(const std::optional<TlsOptions> &tls) -> std::string;
+
+// Returns the session for sending `message` with the given TLS options from the
+// thread-default main context of the calling thread. Sessions, certificate
+// databases and client certificates are created once and shared by every
+// request with equal TLS options, so connections and TLS sessions are reused.
+// Also connects the handlers that count handshakes, present the client
+// certificate and enforce the minimum TLS version to `message`.
+auto prepare_session(SoupMessage *message,
+                     const std::optional<TlsOptions> &tls,
+                     SessionKind kind = SessionKind::kHttp)
+    -> std::variant<std::string, SoupSession *>;
+
+// Destroys the sessions created for `context`. Must only be called once no
+// request is in flight on that context.
+auto release_sessions(GMainContext *context) -> void;
+
+// Returns the error recorded for `message` by the TLS handlers, or nullptr.
+auto tls_error(SoupMessage *message) -> const char *;
+
+// Counts `message` as a reused connection if it is an HTTPS request that was
+// sent without a handshake. Called once the response headers are received.
+auto count_connection_reuse(SoupMessage *message) -> void;
+
+} // namespace benoni
+
+#endif
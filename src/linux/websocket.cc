@@ -0,0 +1,304 @@
+#include <benoni/websocket.h>
+
+#include "session.h"
+
+#include <libsoup/soup.h>
+
+#include <cassert> // assert
+#include <deque>   // std::deque
+#include <memory>  // std::shared_ptr, std::enable_shared_from_this
+#include <string>  // std::string
+#include <variant> // std::variant
+#include <vector>  // std::vector
+
+namespace benoni {
+namespace {
+
+class SoupWebSocket : public WebSocket,
+                      public std::enable_shared_from_this<SoupWebSocket> {
+public:
+  SoupWebSocket(SoupWebsocketConnection *connection, WebSocketHandlers handlers,
+                std::size_t high_water_mark)
+      : connection_{connection}, handlers_{std::move(handlers)},
+        high_water_mark_{high_water_mark} {}
+
+  ~SoupWebSocket() override {
+    StopWaitingForWritable();
+    g_signal_handlers_disconnect_by_data(connection_, this);
+    g_object_unref(connection_);
+  }
+
+  // Connects the signal handlers and keeps the WebSocket alive until the
+  // connection is closed.
+  auto Open() -> void {
+    self_ = shared_from_this();
+    g_signal_connect(connection_, "message",
+                     G_CALLBACK(&SoupWebSocket::MessageCallback), this);
+    g_signal_connect(connection_, "error",
+                     G_CALLBACK(&SoupWebSocket::ErrorCallback), this);
+    g_signal_connect(connection_, "closed",
+                     G_CALLBACK(&SoupWebSocket::ClosedCallback), this);
+    if (handlers_.on_open) {
+      handlers_.on_open(self_);
+    }
+  }
+
+  auto send_text(std::string message) -> bool override {
+    return Send(SOUP_WEBSOCKET_DATA_TEXT, std::move(message));
+  }
+
+  auto send_binary(std::string data) -> bool override {
+    return Send(SOUP_WEBSOCKET_DATA_BINARY, std::move(data));
+  }
+
+  auto buffered_amount() const -> std::size_t override {
+    return buffered_amount_;
+  }
+
+  auto close(uint16_t code, std::string reason) -> void override {
+    if (soup_websocket_connection_get_state(connection_) !=
+        SOUP_WEBSOCKET_STATE_OPEN) {
+      return;
+    }
+    // The close frame is queued behind the buffered messages.
+    FlushPending();
+    soup_websocket_connection_close(connection_, code,
+                                    reason.empty() ? nullptr : reason.c_str());
+  }
+
+private:
+  struct Frame {
+    SoupWebsocketDataType type;
+    std::string data;
+  };
+
+  auto OutputStream() -> GPollableOutputStream * {
+    GOutputStream *stream = g_io_stream_get_output_stream(
+        soup_websocket_connection_get_io_stream(connection_));
+    return G_IS_POLLABLE_OUTPUT_STREAM(stream)
+               ? G_POLLABLE_OUTPUT_STREAM(stream)
+               : nullptr;
+  }
+
+  auto IsWritable() -> bool {
+    GPollableOutputStream *stream = OutputStream();
+    return stream == nullptr || g_pollable_output_stream_is_writable(stream);
+  }
+
+  auto Write(const Frame &frame) -> void {
+    // Sends the whole message, unlike soup_websocket_connection_send_text(),
+    // which stops at the first NUL. libsoup copies the data into a frame
+    // before returning.
+    GBytes *bytes = g_bytes_new_static(frame.data.data(), frame.data.size());
+    soup_websocket_connection_send_message(connection_, frame.type, bytes);
+    g_bytes_unref(bytes);
+  }
+
+  auto Send(SoupWebsocketDataType type, std::string data) -> bool {
+    if (soup_websocket_connection_get_state(connection_) !=
+        SOUP_WEBSOCKET_STATE_OPEN) {
+      return false;
+    }
+
+    Frame frame{.type = type, .data = std::move(data)};
+    if (pending_.empty() && IsWritable()) {
+      Write(frame);
+      return true;
+    }
+
+    buffered_amount_ += frame.data.size();
+    pending_.push_back(std::move(frame));
+    WaitForWritable();
+    if (buffered_amount_ > high_water_mark_) {
+      drain_requested_ = true;
+      return false;
+    }
+    return true;
+  }
+
+  // Hands every buffered message to libsoup.
+  auto FlushPending() -> void {
+    StopWaitingForWritable();
+    while (!pending_.empty()) {
+      Write(pending_.front());
+      pending_.pop_front();
+    }
+    buffered_amount_ = 0;
+  }
+
+  auto WaitForWritable() -> void {
+    if (writable_source_ != nullptr) {
+      return;
+    }
+    GPollableOutputStream *stream = OutputStream();
+    assert(stream != nullptr);
+    writable_source_ = g_pollable_output_stream_create_source(stream, nullptr);
+    g_source_set_callback(writable_source_,
+                          G_SOURCE_FUNC(&SoupWebSocket::WritableCallback), this,
+                          nullptr);
+    g_source_attach(writable_source_, g_main_context_get_thread_default());
+  }
+
+  auto StopWaitingForWritable() -> void {
+    if (writable_source_ == nullptr) {
+      return;
+    }
+    g_source_destroy(writable_source_);
+    g_source_unref(writable_source_);
+    writable_source_ = nullptr;
+  }
+
+  static auto WritableCallback(GObject * /* stream */, gpointer data)
+      -> gboolean {
+    auto web_socket = static_cast<SoupWebSocket *>(data);
+    while (!web_socket->pending_.empty() && web_socket->IsWritable()) {
+      Frame &frame = web_socket->pending_.front();
+      web_socket->Write(frame);
+      web_socket->buffered_amount_ -= frame.data.size();
+      web_socket->pending_.pop_front();
+    }
+
+    if (!web_socket->pending_.empty()) {
+      return G_SOURCE_CONTINUE;
+    }
+
+    g_source_unref(web_socket->writable_source_);
+    web_socket->writable_source_ = nullptr;
+    if (web_socket->drain_requested_) {
+      web_socket->drain_requested_ = false;
+      if (web_socket->handlers_.on_drain) {
+        web_socket->handlers_.on_drain();
+      }
+    }
+    return G_SOURCE_REMOVE;
+  }
+
+  static auto MessageCallback(SoupWebsocketConnection * /* connection */,
+                              gint type, GBytes *message, gpointer data)
+      -> void {
+    auto web_socket = static_cast<SoupWebSocket *>(data);
+    gsize size = 0;
+    auto bytes = static_cast<const char *>(g_bytes_get_data(message, &size));
+    std::string payload{bytes != nullptr ? bytes : "", size};
+    if (type == SOUP_WEBSOCKET_DATA_TEXT) {
+      if (web_socket->handlers_.on_message) {
+        web_socket->handlers_.on_message(std::move(payload));
+      }
+    } else if (web_socket->handlers_.on_binary) {
+      web_socket->handlers_.on_binary(std::move(payload));
+    }
+  }
+
+  static auto ErrorCallback(SoupWebsocketConnection * /* connection */,
+                            GError *error, gpointer data) -> void {
+    auto web_socket = static_cast<SoupWebSocket *>(data);
+    if (web_socket->handlers_.on_error) {
+      web_socket->handlers_.on_error(error->message);
+    }
+  }
+
+  static auto ClosedCallback(SoupWebsocketConnection *connection,
+                             gpointer data) -> void {
+    auto web_socket = static_cast<SoupWebSocket *>(data);
+    // Keeps the WebSocket alive until the handler returns.
+    std::shared_ptr<SoupWebSocket> self = std::move(web_socket->self_);
+    web_socket->StopWaitingForWritable();
+    web_socket->pending_.clear();
+    web_socket->buffered_amount_ = 0;
+
+    const char *reason = soup_websocket_connection_get_close_data(connection);
+    if (web_socket->handlers_.on_close) {
+      web_socket->handlers_.on_close(
+          soup_websocket_connection_get_close_code(connection),
+          reason != nullptr ? reason : "");
+    }
+  }
+
+  SoupWebsocketConnection *connection_;
+  WebSocketHandlers handlers_;
+  std::size_t high_water_mark_;
+
+  std::deque<Frame> pending_;
+  std::size_t buffered_amount_ = 0;
+  bool drain_requested_ = false;
+  GSource *writable_source_ = nullptr;
+
+  std::shared_ptr<SoupWebSocket> self_;
+};
+
+struct ConnectContext {
+  WebSocketHandlers handlers;
+  std::size_t high_water_mark;
+};
+
+auto websocket_connect_callback(GObject *object, GAsyncResult *result,
+                                gpointer data) -> void {
+  std::unique_ptr<ConnectContext> connect_context{
+      static_cast<ConnectContext *>(data)};
+
+  GError *error = nullptr;
+  SoupWebsocketConnection *connection = soup_session_websocket_connect_finish(
+      SOUP_SESSION(object), result, &error);
+  if (connection == nullptr) {
+    assert(error);
+    std::string error_message{error->message};
+    g_error_free(error);
+    if (connect_context->handlers.on_error) {
+      connect_context->handlers.on_error(std::move(error_message));
+    }
+    return;
+  }
+
+  auto web_socket = std::make_shared<SoupWebSocket>(
+      connection, std::move(connect_context->handlers),
+      connect_context->high_water_mark);
+  web_socket->Open();
+}
+
+} // namespace
+
+auto websocket_connect(const std::string &url, WebSocketOptions options,
+                       WebSocketHandlers handlers) -> void {
+  SoupMessage *message = soup_message_new("GET", url.c_str());
+  if (message == nullptr) {
+    if (handlers.on_error) {
+      handlers.on_error("The uri could not be parsed");
+    }
+    return;
+  }
+
+  for (const auto &[name, value] : options.headers()) {
+    soup_message_headers_append(message->request_headers, name.c_str(),
+                                value.c_str());
+  }
+
+  auto session = prepare_session(message, options.tls(),
+                                 options.permessage_deflate()
+                                     ? SessionKind::kWebSocketDeflate
+                                     : SessionKind::kWebSocket);
+  if (std::holds_alternative<std::string>(session)) {
+    g_object_unref(message);
+    if (handlers.on_error) {
+      handlers.on_error(std::get<std::string>(std::move(session)));
+    }
+    return;
+  }
+
+  // NULL-terminated array of the offered subprotocols.
+  std::vector<char *> protocols;
+  for (const auto &protocol : options.protocols()) {
+    protocols.push_back(const_cast<char *>(protocol.c_str()));
+  }
+  protocols.push_back(nullptr);
+
+  auto connect_context = new ConnectContext{
+      .handlers = std::move(handlers),
+      .high_water_mark = options.high_water_mark()};
+  soup_session_websocket_connect_async(
+      std::get<SoupSession *>(session), message, nullptr,
+      options.protocols().empty() ? nullptr : protocols.data(), nullptr,
+      websocket_connect_callback, connect_context);
+  g_object_unref(message);
+}
+
+} // namespace benoni
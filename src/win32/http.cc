@@ -1,13 +1,24 @@
 #include <benoni/http.h>
+#include <benoni/websocket.h>
+
+#include "common/concurrency.h"
+#include "common/replay.h"
 
 #include <Windows.h>
 #include <winhttp.h>
 
-#include <cassert> // assert
-#include <map>     // std::map
-#include <sstream> // std::stringtream
-#include <string>  // std::string
-#include <variant> // std::variant
+#include <cassert>         // assert
+#include <chrono>          // std::chrono
+#include <functional>      // std::function
+#include <future>          // std::promise
+#include <map>             // std::map
+#include <memory>          // std::make_shared, std::unique_ptr
+#include <memory_resource> // std::pmr::memory_resource, std::pmr::string
+#include <mutex>           // std::call_once, std::once_flag
+#include <ratio>           // std::ratio
+#include <sstream>         // std::istringstream
+#include <string>          // std::string
+#include <variant>         // std::variant
 
 namespace benoni {
 namespace {
@@ -202,20 +213,24 @@ class HTTPClient {
 public:
   static auto
   Req(std::string url, Method method,
+      std::pmr::memory_resource *memory_resource,
       std::function<void(std::variant<std::string, Response>)> callback)
       -> void {
-    new HTTPClient{std::move(url), method, std::move(callback)};
+    new HTTPClient{std::move(url), method, memory_resource,
+                   std::move(callback)};
   }
 
 private:
   HTTPClient(std::string url, Method method,
+             std::pmr::memory_resource *memory_resource,
              std::function<void(std::variant<std::string, Response>)> callback)
       : callback_{std::move(callback)}, url_{callback_, std::move(url)},
         session_{callback_},
         connection_{callback_, session_.Get(), url_.hostname()},
         request_{callback_, connection_.Get(), url_.scheme(), url_.path(),
                  method},
-        status_{}, headers_{}, dwSize_{}, body_{} {
+        status_{}, headers_{memory_resource}, dwSize_{},
+        body_{memory_resource} {
     DWORD_PTR option_context = reinterpret_cast<DWORD_PTR>(this);
     if (WinHttpSetOption(request_.Get(), WINHTTP_OPTION_CONTEXT_VALUE,
                          &option_context, sizeof(option_context)) == FALSE) {
@@ -362,7 +377,7 @@ private:
     dwSize_ = dwSize;
     if (dwSize_ == 0) {
       // complete
-      callback_(Response{body_.str(), status_, std::move(headers_)});
+      callback_(Response{std::move(body_), status_, std::move(headers_)});
       delete this;
       return;
     } else {
@@ -388,8 +403,7 @@ private:
 
     // Append the read data to the response body and delete it.
     std::unique_ptr<char[]> raw_data{static_cast<char *>(buffer)};
-    std::string data{raw_data.get(), bytes_read};
-    body_ << data;
+    body_.append(raw_data.get(), bytes_read);
   }
 
   static auto WinHttpStatusCallback(HINTERNET /* hInternet */,
@@ -432,17 +446,135 @@ private:
   Request request_;
 
   uint16_t status_;
-  std::multimap<std::string, std::string> headers_;
+  ResponseHeaders headers_;
   DWORD dwSize_;
-  std::stringstream body_;
+  std::pmr::string body_;
 };
 
+// Runs and frees a task that was handed to the Windows thread pool.
+auto run_task(PVOID data) -> void {
+  std::unique_ptr<std::function<void()>> task{
+      static_cast<std::function<void()> *>(data)};
+  (*task)();
+}
+
+// The unit of FILETIME.
+using FileTimeTicks = std::chrono::duration<LONGLONG, std::ratio<1, 10000000>>;
+
+// Calls `task` from the Windows thread pool once `delay` has passed, or right
+// away on the calling thread if the pool cannot take it.
+auto run_after(std::chrono::nanoseconds delay, std::function<void()> task)
+    -> void {
+  auto data = new std::function<void()>{std::move(task)};
+  if (delay <= std::chrono::nanoseconds::zero()) {
+    if (TrySubmitThreadpoolCallback(
+            [](PTP_CALLBACK_INSTANCE /* instance */, PVOID data) {
+              run_task(data);
+            },
+            data, nullptr) == FALSE) {
+      run_task(data);
+    }
+    return;
+  }
+
+  PTP_TIMER timer = CreateThreadpoolTimer(
+      [](PTP_CALLBACK_INSTANCE /* instance */, PVOID data, PTP_TIMER timer) {
+        // The pool frees the timer once this callback returns.
+        CloseThreadpoolTimer(timer);
+        run_task(data);
+      },
+      data, nullptr);
+  if (timer == nullptr) {
+    run_task(data);
+    return;
+  }
+
+  // A negative due time is relative to the current time.
+  LARGE_INTEGER due_time;
+  due_time.QuadPart = -std::chrono::ceil<FileTimeTicks>(delay).count();
+  FILETIME file_time{.dwLowDateTime = due_time.LowPart,
+                     .dwHighDateTime = static_cast<DWORD>(due_time.HighPart)};
+  SetThreadpoolTimer(timer, &file_time, 0, 0);
+}
+
 } // namespace
 
 auto request(const std::string &url, RequestOptions options,
              std::function<void(std::variant<std::string, Response>)> callback)
     -> void {
-  HTTPClient::Req(url, options.method(), std::move(callback));
+  if (auto replayed = replay::find(url, options)) {
+    run_after(replayed->delay, [result = std::move(replayed->result),
+                                callback = std::move(callback)]() mutable {
+      callback(std::move(result));
+    });
+    return;
+  }
+
+  concurrency::dispatch(
+      url, std::move(callback),
+      [url, options = std::move(options)](
+          std::function<void(std::variant<std::string, Response>)>
+              callback) {
+        callback = replay::record_callback(url, options, std::move(callback));
+        HTTPClient::Req(url, options.method(), options.memory_resource(),
+                        std::move(callback));
+      },
+      [](std::chrono::milliseconds delay, std::function<void()> task) {
+        run_after(delay, std::move(task));
+      });
+}
+
+auto request_sync(const std::string &url, RequestOptions options)
+    -> std::variant<std::string, Response> {
+  // The callback runs on a WinHTTP worker thread, so the calling thread can
+  // block until it does. HTTPClient may report more than one error for a
+  // request, only the first result is kept.
+  struct SyncResult {
+    std::promise<std::variant<std::string, Response>> promise;
+    std::once_flag once;
+  };
+  auto sync_result = std::make_shared<SyncResult>();
+  auto future = sync_result->promise.get_future();
+  request(url, std::move(options),
+          [sync_result](std::variant<std::string, Response> result) {
+            std::call_once(sync_result->once, [&] {
+              sync_result->promise.set_value(std::move(result));
+            });
+          });
+  return future.get();
+}
+
+// The system HTTP stack already runs requests on its own threads, so the
+// engine forwards them to request().
+class Engine::Impl {};
+
+Engine::Engine(EngineOptions /* options */)
+    : impl_{std::make_unique<Impl>()} {}
+
+Engine::~Engine() = default;
+
+auto Engine::request(
+    const std::string &url, RequestOptions options,
+    std::function<void(std::variant<std::string, Response>)> callback) -> void {
+  benoni::request(url, std::move(options), std::move(callback));
+}
+
+auto websocket_connect(const std::string & /* url */,
+                       WebSocketOptions /* options */,
+                       WebSocketHandlers handlers) -> void {
+  if (handlers.on_error) {
+    handlers.on_error("WebSocket is not supported on this platform");
+  }
+}
+
+auto tls_stats() -> TlsStats {
+  // The system HTTP stack manages TLS sessions here and does not expose
+  // handshake counts.
+  return TlsStats{.handshakes = 0, .reused_connections = 0};
+}
+
+auto reload_tls_files() -> void {
+  // Certificate files are not cached here.
 }
 
 } // namespace benoni
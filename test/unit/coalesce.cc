@@ -0,0 +1,121 @@
+#include <benoni/http.h>
+
+#include "local-server.h"
+
+#include <glib.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+using benoni::request;
+using benoni::RequestOptions;
+using benoni::RequestOptionsBuilder;
+using benoni::Response;
+using benoni::TlsOptionsBuilder;
+using benoni::TlsVersion;
+
+namespace {
+
+// Sends every request at once from the default main context, and returns the
+// bodies of their responses once they all completed.
+auto send_all(const std::string &url, std::vector<RequestOptions> requests)
+    -> std::vector<std::string> {
+  std::size_t completed = 0;
+  std::vector<std::string> bodies;
+  std::size_t count = requests.size();
+  for (auto &options : requests) {
+    request(url, std::move(options),
+            [&](std::variant<std::string, Response> result) {
+              if (std::holds_alternative<std::string>(result)) {
+                std::cerr << "error: [" << std::get<std::string>(result) << "]"
+                          << std::endl;
+              } else {
+                bodies.emplace_back(std::get<Response>(result).body);
+              }
+              ++completed;
+            });
+  }
+  while (completed < count) {
+    g_main_context_iteration(nullptr, TRUE);
+  }
+  return bodies;
+}
+
+auto coalesced() -> RequestOptionsBuilder {
+  RequestOptionsBuilder builder;
+  builder.set_coalesce(true);
+  return builder;
+}
+
+// Identical requests share one request to the server.
+auto test_identical() -> bool {
+  constexpr std::size_t kRequests = 8;
+  StaticServer server{"benoni"};
+  std::string url = server.url("/coalesce");
+  std::cout << "sending " << kRequests << " requests to: \"" << url << "\""
+            << std::endl;
+
+  std::vector<RequestOptions> requests;
+  for (std::size_t i = 0; i < kRequests; ++i) {
+    requests.push_back(coalesced().build());
+  }
+  std::vector<std::string> bodies = send_all(url, std::move(requests));
+
+  if (server.requests().size() != 1) {
+    std::cerr << "server received " << server.requests().size()
+              << " requests instead of 1" << std::endl;
+    return false;
+  }
+  if (bodies.size() != kRequests) {
+    std::cerr << bodies.size() << " of " << kRequests
+              << " callbacks received a response" << std::endl;
+    return false;
+  }
+  for (const auto &body : bodies) {
+    if (body != "benoni") {
+      std::cerr << "unexpected body: \"" << body << "\"" << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+// Requests that differ in their headers or TLS options are sent separately.
+auto test_different() -> bool {
+  StaticServer server{"benoni"};
+  std::string url = server.url("/coalesce");
+  std::cout << "sending different requests to: \"" << url << "\""
+            << std::endl;
+
+  std::vector<RequestOptions> requests;
+  requests.push_back(coalesced().build());
+  requests.push_back(coalesced().build());
+  requests.push_back(
+      coalesced().set_headers({{"Accept", "text/plain"}}).build());
+  requests.push_back(
+      coalesced()
+          .set_tls(TlsOptionsBuilder{}
+                       .set_minimum_version(TlsVersion::TLS_1_2)
+                       .build())
+          .build());
+  std::vector<std::string> bodies = send_all(url, std::move(requests));
+
+  if (bodies.size() != 4) {
+    std::cerr << bodies.size() << " of 4 callbacks received a response"
+              << std::endl;
+    return false;
+  }
+  if (server.requests().size() != 3) {
+    std::cerr << "server received " << server.requests().size()
+              << " requests instead of 3" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+} // namespace
+
+int main() {
+  return test_identical() && test_different() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
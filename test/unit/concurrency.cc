@@ -0,0 +1,199 @@
+#include <benoni/concurrency.h>
+
+#include "common/concurrency.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+using benoni::AdaptiveConcurrencyOptionsBuilder;
+using benoni::Response;
+
+namespace {
+
+using Callback = std::function<void(std::variant<std::string, Response>)>;
+
+// Drives the limiter without any network: sends are held until a test
+// completes them, timers until a test fires them and tasks the limiter posts
+// back to the caller until a test runs them.
+struct FakeHost {
+  std::vector<Callback> sent;
+  std::vector<std::string> results;
+  std::vector<std::function<void()>> timers;
+  std::vector<std::function<void()>> posted;
+
+  auto Dispatch() -> void {
+    benoni::concurrency::dispatch(
+        "https://example.com/path",
+        [this](std::variant<std::string, Response> result) {
+          results.push_back(std::holds_alternative<std::string>(result)
+                                ? std::get<std::string>(result)
+                                : std::to_string(
+                                      std::get<Response>(result).status));
+        },
+        [this](Callback callback) { sent.push_back(std::move(callback)); },
+        [this](std::chrono::milliseconds delay, std::function<void()> task) {
+          (delay.count() > 0 ? timers : posted).push_back(std::move(task));
+        });
+  }
+
+  auto RunPosted() -> void {
+    std::vector<std::function<void()>> tasks = std::move(posted);
+    posted.clear();
+    for (auto &task : tasks) {
+      task();
+    }
+  }
+
+  auto Complete(std::size_t index, uint16_t status) -> void {
+    sent[index](Response{.body = {}, .status = status, .headers = {}});
+  }
+};
+
+auto check(bool condition, const char *message) -> bool {
+  if (!condition) {
+    std::cerr << message << std::endl;
+  }
+  return condition;
+}
+
+// Requests over the limit are queued, and requests over the queue are
+// rejected right away.
+auto test_queue() -> bool {
+  benoni::enable_adaptive_concurrency(AdaptiveConcurrencyOptionsBuilder{}
+                                          .set_initial_limit(2)
+                                          .set_latency_tolerance(1e9)
+                                          .set_max_queue(1)
+                                          .build());
+  FakeHost host;
+  for (int i = 0; i < 4; ++i) {
+    host.Dispatch();
+  }
+  if (!check(host.sent.size() == 2, "requests over the limit were sent") ||
+      !check(host.results.size() == 1 &&
+                 host.results[0] == "Concurrency limit reached for the host",
+             "request over the queue was not rejected")) {
+    return false;
+  }
+
+  // The queued request is started from its own caller rather than from the
+  // callback of the request that completed.
+  host.Complete(0, 200);
+  if (!check(host.sent.size() == 2 && host.posted.size() == 1,
+             "queued request was started by another request")) {
+    return false;
+  }
+  host.RunPosted();
+  return check(host.sent.size() == 3,
+               "queued request was not sent after a completion");
+}
+
+// A queued request is rejected by its timer even if no request completes.
+auto test_queue_timeout() -> bool {
+  benoni::enable_adaptive_concurrency(AdaptiveConcurrencyOptionsBuilder{}
+                                          .set_initial_limit(1)
+                                          .set_latency_tolerance(1e9)
+                                          .build());
+  FakeHost host;
+  host.Dispatch();
+  host.Dispatch();
+  host.Dispatch();
+  if (!check(host.timers.size() == 2, "queued requests armed no timer")) {
+    return false;
+  }
+
+  host.timers[0]();
+  if (!check(host.results.size() == 1 &&
+                 host.results[0] ==
+                     "Timed out waiting for the concurrency limit of the host",
+             "queued request was not rejected by its timer")) {
+    return false;
+  }
+
+  // The second queued request is sent, so its timer must not reject it.
+  host.Complete(0, 200);
+  host.timers[1]();
+  host.RunPosted();
+  return check(host.sent.size() == 2 && host.results.size() == 2 &&
+                   host.results[1] == "200",
+               "timer rejected a request that was already sent");
+}
+
+// A host that uses a fraction of its limit does not raise it.
+auto test_no_increase_when_idle() -> bool {
+  benoni::enable_adaptive_concurrency(AdaptiveConcurrencyOptionsBuilder{}
+                                          .set_initial_limit(4)
+                                          .set_limits(1, 100)
+                                          .set_latency_tolerance(1e9)
+                                          .build());
+  FakeHost host;
+  for (std::size_t i = 0; i < 100; ++i) {
+    host.Dispatch();
+    host.Complete(i, 200);
+  }
+
+  std::size_t sent = host.sent.size();
+  for (int i = 0; i < 5; ++i) {
+    host.Dispatch();
+  }
+  return check(host.sent.size() - sent == 4,
+               "limit grew while the host was mostly idle");
+}
+
+// Failed requests shrink the limit by the backoff ratio.
+auto test_backoff() -> bool {
+  benoni::enable_adaptive_concurrency(AdaptiveConcurrencyOptionsBuilder{}
+                                          .set_initial_limit(4)
+                                          .set_backoff_ratio(0.5)
+                                          .set_latency_tolerance(1e9)
+                                          .build());
+  FakeHost host;
+  for (int i = 0; i < 4; ++i) {
+    host.Dispatch();
+  }
+  // Three requests remain in flight, above the new limit of two.
+  host.Complete(0, 503);
+  host.Dispatch();
+  return check(host.sent.size() == 4,
+               "limit did not shrink after a failed request");
+}
+
+// A request whose backend reports more than one result only completes once.
+auto test_repeated_completion() -> bool {
+  benoni::enable_adaptive_concurrency(AdaptiveConcurrencyOptionsBuilder{}
+                                          .set_initial_limit(1)
+                                          .set_latency_tolerance(1e9)
+                                          .build());
+  FakeHost host;
+  host.Dispatch();
+  host.Complete(0, 503);
+  host.Complete(0, 503);
+  if (!check(host.results.size() == 1,
+             "callback was called for every result of a request")) {
+    return false;
+  }
+
+  host.Dispatch();
+  host.Dispatch();
+  return check(host.sent.size() == 2,
+               "repeated results broke the count of requests in flight");
+}
+
+} // namespace
+
+int main() {
+  bool passed = test_queue() && test_queue_timeout() &&
+                test_no_increase_when_idle() && test_backoff() &&
+                test_repeated_completion();
+  benoni::disable_adaptive_concurrency();
+
+  // Without a limiter, requests are sent right away.
+  FakeHost host;
+  for (int i = 0; i < 3; ++i) {
+    host.Dispatch();
+  }
+  passed = passed && check(host.sent.size() == 3,
+                           "requests were limited after disabling the limiter");
+
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,128 @@
+#include <benoni/http.h>
+
+#include "local-server.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using benoni::Engine;
+using benoni::EngineOptionsBuilder;
+using benoni::RequestOptionsBuilder;
+using benoni::Response;
+
+namespace {
+
+// Records the threads callbacks run on. Every callback waits until at least
+// two callbacks have started, which a pool that runs all of them on one
+// thread never lets happen.
+class CallbackThreads {
+public:
+  auto Enter() -> void {
+    std::unique_lock<std::mutex> lock{mutex_};
+    threads_.insert(std::this_thread::get_id());
+    ++started_;
+    started_changed_.notify_all();
+    started_changed_.wait_for(lock, std::chrono::seconds{10},
+                              [this] { return started_ >= 2; });
+  }
+
+  auto threads() -> std::set<std::thread::id> {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return threads_;
+  }
+
+private:
+  std::mutex mutex_;
+  std::condition_variable started_changed_;
+  std::size_t started_ = 0;
+  std::set<std::thread::id> threads_;
+};
+
+} // namespace
+
+int main() {
+  constexpr std::size_t kRequestsPerServer = 4;
+  // Different ports are different hosts for the engine, which spreads them
+  // over its I/O threads.
+  StaticServer first_server{"first"};
+  StaticServer second_server{"second"};
+  std::vector<std::pair<std::string, const char *>> urls;
+  for (std::size_t i = 0; i < kRequestsPerServer; ++i) {
+    urls.emplace_back(first_server.url("/engine?i=" + std::to_string(i)),
+                      "first");
+    urls.emplace_back(second_server.url("/engine?i=" + std::to_string(i)),
+                      "second");
+  }
+
+  std::atomic<std::size_t> completed{0};
+  std::atomic<std::size_t> failed{0};
+  std::thread::id main_thread = std::this_thread::get_id();
+  CallbackThreads callback_threads;
+
+  {
+    Engine engine{EngineOptionsBuilder{}
+                      .set_io_threads(2)
+                      .set_callback_threads(2)
+                      .build()};
+    for (const auto &[url, body] : urls) {
+      std::cout << "sending request to: \"" << url << "\"" << std::endl;
+      engine.request(
+          url, RequestOptionsBuilder{}.build(),
+          [&, url = url, body = body](
+              std::variant<std::string, Response> result) {
+            callback_threads.Enter();
+            // No main loop runs on this thread, callbacks run on the engine's
+            // own threads.
+            if (std::this_thread::get_id() == main_thread) {
+              std::cerr << "callback ran on the main thread" << std::endl;
+              ++failed;
+            } else if (std::holds_alternative<std::string>(result)) {
+              std::cerr << url << " error: [" << std::get<std::string>(result)
+                        << "]" << std::endl;
+              ++failed;
+            } else if (std::get<Response>(result).status != 200 ||
+                       std::get<Response>(result).body != body) {
+              std::cerr << url << " response status: "
+                        << std::get<Response>(result).status << ", body: \""
+                        << std::get<Response>(result).body << "\""
+                        << std::endl;
+              ++failed;
+            }
+            ++completed;
+          });
+    }
+    // The destructor waits for every request and its callback.
+  }
+
+  if (completed != urls.size()) {
+    std::cerr << completed << " of " << urls.size()
+              << " callbacks ran before the engine was destroyed" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (first_server.requests().size() != kRequestsPerServer ||
+      second_server.requests().size() != kRequestsPerServer) {
+    std::cerr << "servers received " << first_server.requests().size()
+              << " and " << second_server.requests().size()
+              << " requests instead of " << kRequestsPerServer << " each"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::size_t threads = callback_threads.threads().size();
+  if (threads < 2) {
+    std::cerr << "callbacks ran on " << threads
+              << " pool threads instead of 2" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,230 @@
+#include <benoni/http.h>
+
+#include "local-server.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+using benoni::Method;
+using benoni::request_sync;
+using benoni::RequestOptions;
+using benoni::RequestOptionsBuilder;
+using benoni::Response;
+
+namespace {
+
+auto has_expect_continue(std::string headers) -> bool {
+  std::transform(headers.begin(), headers.end(), headers.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  return headers.find("\r\nexpect: 100-continue\r\n") != std::string::npos;
+}
+
+auto upload_options(const std::string &body) -> RequestOptions {
+  return RequestOptionsBuilder{}
+      .set_method(Method::POST)
+      .set_body(body)
+      .set_headers({{"Content-Type", "application/octet-stream"}})
+      .set_expect_continue(true)
+      .build();
+}
+
+// postman-echo accepts the headers and echoes them back.
+auto test_accepted() -> bool {
+  std::string url{"https://postman-echo.com/post"};
+  std::cout << "sending request to: \"" << url << "\"" << std::endl;
+
+  std::variant<std::string, Response> result = request_sync(
+      url, RequestOptionsBuilder{}
+               .set_method(Method::POST)
+               .set_body("benoni")
+               .set_headers({{"Content-Type", "text/plain"}})
+               .set_expect_continue(true)
+               .build());
+  if (std::holds_alternative<std::string>(result)) {
+    std::cerr << "error: [" << std::get<std::string>(result) << "]"
+              << std::endl;
+    return false;
+  }
+
+  const Response &response = std::get<Response>(result);
+  if (response.status != 200 ||
+      response.body.find("\"expect\": \"100-continue\"") ==
+          std::string::npos ||
+      response.body.find("\"data\": \"benoni\"") == std::string::npos) {
+    std::cerr << "unexpected response " << response.status << ": \""
+              << response.body << "\"" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// A server that rejects the headers gets none of the body.
+auto test_rejected() -> bool {
+  LocalServer server;
+  std::cout << "sending request to: \"" << server.url("/upload") << "\""
+            << std::endl;
+
+  std::string headers;
+  std::size_t body_bytes = 0;
+  std::thread server_thread{[&]() {
+    int connection = server.Accept();
+    headers = read_headers(connection);
+    write_all(connection, "HTTP/1.1 413 Payload Too Large\r\n"
+                          "Content-Length: 0\r\n"
+                          "Connection: close\r\n\r\n");
+    body_bytes =
+        read_until(connection, std::chrono::milliseconds{500},
+                   [](const std::string &) { return false; })
+            .size();
+    close(connection);
+  }};
+
+  std::variant<std::string, Response> result = request_sync(
+      server.url("/upload"), upload_options(std::string(1024 * 1024, 'x')));
+  server_thread.join();
+
+  if (!has_expect_continue(headers)) {
+    std::cerr << "Expect header not sent: \"" << headers << "\"" << std::endl;
+    return false;
+  }
+  if (std::holds_alternative<std::string>(result) ||
+      std::get<Response>(result).status != 413) {
+    std::cerr << "early final response was not delivered" << std::endl;
+    return false;
+  }
+  if (headers.find("\r\n\r\n") + 4 != headers.size() || body_bytes != 0) {
+    std::cerr << "body was sent after the server rejected it" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// A server that ignores the Expect header gets the request again without it.
+auto test_ignored() -> bool {
+  LocalServer server;
+  std::cout << "sending request to: \"" << server.url("/upload") << "\""
+            << std::endl;
+
+  std::string body(64 * 1024, 'x');
+  std::string first_headers;
+  std::size_t first_body_bytes = 0;
+  std::string second_request;
+  std::thread server_thread{[&]() {
+    // Waits for the body without answering, until the client gives up.
+    int connection = server.Accept();
+    first_headers = read_headers(connection);
+    first_body_bytes =
+        read_until(connection, std::chrono::seconds{10},
+                   [](const std::string &) { return false; })
+            .size();
+    close(connection);
+
+    connection = server.Accept();
+    second_request =
+        read_until(connection, std::chrono::seconds{10},
+                   [&body](const std::string &data) {
+                     std::size_t end = data.find("\r\n\r\n");
+                     return end != std::string::npos &&
+                            data.size() - end - 4 >= body.size();
+                   });
+    write_all(connection, "HTTP/1.1 200 OK\r\n"
+                          "Content-Length: 2\r\n"
+                          "Connection: close\r\n\r\nok");
+    close(connection);
+  }};
+
+  std::variant<std::string, Response> result =
+      request_sync(server.url("/upload"), upload_options(body));
+  server_thread.join();
+
+  if (!has_expect_continue(first_headers) || first_body_bytes != 0) {
+    std::cerr << "first request did not wait for 100 Continue" << std::endl;
+    return false;
+  }
+  std::size_t end = second_request.find("\r\n\r\n");
+  if (end == std::string::npos ||
+      has_expect_continue(second_request.substr(0, end + 4)) ||
+      second_request.substr(end + 4) != body) {
+    std::cerr << "request was not resent with its body and without Expect"
+              << std::endl;
+    return false;
+  }
+  if (std::holds_alternative<std::string>(result) ||
+      std::get<Response>(result).body != "ok") {
+    std::cerr << "response to the resent request was not delivered"
+              << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// A server that accepts the connection late still gets the Expect header,
+// since the timeout only starts once the headers are written.
+auto test_slow_connect() -> bool {
+  // The listener queues a single connection, which the server holds back for
+  // longer than the timeout, so the kernel drops the attempts of the client to
+  // connect until it retries after the filler is accepted.
+  LocalServer server{0};
+  int filler = server.Connect();
+  std::cout << "sending request to: \"" << server.url("/upload") << "\""
+            << std::endl;
+
+  std::string body(64 * 1024, 'x');
+  std::string headers;
+  std::string received_body;
+  std::thread server_thread{[&]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds{2500});
+    close(server.Accept());
+
+    int connection = server.Accept();
+    headers = read_headers(connection);
+    std::size_t end = headers.find("\r\n\r\n");
+    received_body = headers.substr(end + 4);
+    headers.resize(end + 4);
+    write_all(connection, "HTTP/1.1 100 Continue\r\n\r\n");
+    received_body += read_until(
+        connection, std::chrono::seconds{10},
+        [&](const std::string &data) {
+          return received_body.size() + data.size() >= body.size();
+        });
+    write_all(connection, "HTTP/1.1 200 OK\r\n"
+                          "Content-Length: 2\r\n"
+                          "Connection: close\r\n\r\nok");
+    close(connection);
+  }};
+
+  auto start = std::chrono::steady_clock::now();
+  std::variant<std::string, Response> result =
+      request_sync(server.url("/upload"), upload_options(body));
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  server_thread.join();
+  close(filler);
+
+  if (elapsed < std::chrono::milliseconds{2500}) {
+    std::cerr << "the connection was not delayed" << std::endl;
+    return false;
+  }
+  if (!has_expect_continue(headers)) {
+    std::cerr << "request was resent without Expect while connecting: \""
+              << headers << "\"" << std::endl;
+    return false;
+  }
+  if (received_body != body || std::holds_alternative<std::string>(result) ||
+      std::get<Response>(result).body != "ok") {
+    std::cerr << "body was not sent after 100 Continue" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+} // namespace
+
+int main() {
+  return test_accepted() && test_rejected() && test_ignored() &&
+                 test_slow_connect()
+             ? EXIT_SUCCESS
+             : EXIT_FAILURE;
+}
@@ -0,0 +1,164 @@
+#ifndef BENONI_TEST_UNIT_LOCAL_SERVER_H_
+#define BENONI_TEST_UNIT_LOCAL_SERVER_H_
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Accepts connections on a loopback port, so that a test sees exactly what
+// the client sends.
+class LocalServer {
+public:
+  // `backlog` is the number of connections the listener queues before it
+  // drops connection attempts.
+  explicit LocalServer(int backlog = 4)
+      : listener_{socket(AF_INET, SOCK_STREAM, 0)} {
+    address_.sin_family = AF_INET;
+    address_.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t size = sizeof(address_);
+    if (bind(listener_, reinterpret_cast<sockaddr *>(&address_), size) != 0 ||
+        listen(listener_, backlog) != 0 ||
+        getsockname(listener_, reinterpret_cast<sockaddr *>(&address_),
+                    &size) != 0) {
+      std::cerr << "could not listen on a loopback port" << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+  }
+
+  ~LocalServer() { close(listener_); }
+
+  LocalServer(const LocalServer &) = delete;
+  LocalServer &operator=(const LocalServer &) = delete;
+
+  auto url(const std::string &path) const -> std::string {
+    return "http://127.0.0.1:" + std::to_string(ntohs(address_.sin_port)) +
+           path;
+  }
+
+  // Returns -1 if no client connects within `timeout`.
+  auto Accept(std::chrono::milliseconds timeout = std::chrono::seconds{10})
+      -> int {
+    pollfd poll_fd{.fd = listener_, .events = POLLIN, .revents = 0};
+    if (poll(&poll_fd, 1, static_cast<int>(timeout.count())) <= 0) {
+      return -1;
+    }
+    return accept(listener_, nullptr, nullptr);
+  }
+
+  // Opens a connection to the server that waits to be accepted.
+  auto Connect() const -> int {
+    int connection = socket(AF_INET, SOCK_STREAM, 0);
+    if (connect(connection, reinterpret_cast<const sockaddr *>(&address_),
+                sizeof(address_)) != 0) {
+      std::cerr << "could not connect to the loopback port" << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+    return connection;
+  }
+
+private:
+  int listener_;
+  sockaddr_in address_{};
+};
+
+// Reads from `connection` until `done` returns true for the data read so far,
+// the client closes the connection or nothing arrives for `timeout`.
+template <typename Done>
+auto read_until(int connection, std::chrono::milliseconds timeout, Done done)
+    -> std::string {
+  std::string data;
+  while (!done(data)) {
+    pollfd poll_fd{.fd = connection, .events = POLLIN, .revents = 0};
+    if (poll(&poll_fd, 1, static_cast<int>(timeout.count())) <= 0) {
+      break;
+    }
+    char buffer[16384];
+    ssize_t size = read(connection, buffer, sizeof(buffer));
+    if (size <= 0) {
+      break;
+    }
+    data.append(buffer, static_cast<std::size_t>(size));
+  }
+  return data;
+}
+
+inline auto read_headers(int connection) -> std::string {
+  return read_until(connection, std::chrono::seconds{10},
+                    [](const std::string &data) {
+                      return data.find("\r\n\r\n") != std::string::npos;
+                    });
+}
+
+inline auto write_all(int connection, const std::string &data) -> void {
+  std::size_t written = 0;
+  while (written < data.size()) {
+    ssize_t size =
+        write(connection, data.data() + written, data.size() - written);
+    if (size <= 0) {
+      return;
+    }
+    written += static_cast<std::size_t>(size);
+  }
+}
+
+// Answers every request with `body` from its own thread until it is
+// destroyed, one connection at a time, and records the head of every request.
+class StaticServer {
+public:
+  explicit StaticServer(std::string body)
+      : body_{std::move(body)}, thread_{[this] { Run(); }} {}
+
+  ~StaticServer() {
+    stopping_ = true;
+    thread_.join();
+  }
+
+  auto url(const std::string &path) const -> std::string {
+    return server_.url(path);
+  }
+
+  auto requests() -> std::vector<std::string> {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return requests_;
+  }
+
+private:
+  auto Run() -> void {
+    while (!stopping_) {
+      int connection = server_.Accept(std::chrono::milliseconds{100});
+      if (connection < 0) {
+        continue;
+      }
+      std::string head = read_headers(connection);
+      {
+        std::lock_guard<std::mutex> lock{mutex_};
+        requests_.push_back(std::move(head));
+      }
+      write_all(connection, "HTTP/1.1 200 OK\r\nContent-Length: " +
+                                std::to_string(body_.size()) +
+                                "\r\nConnection: close\r\n\r\n" + body_);
+      close(connection);
+    }
+  }
+
+  LocalServer server_;
+  std::string body_;
+  std::atomic<bool> stopping_{false};
+  std::mutex mutex_;
+  std::vector<std::string> requests_;
+  // Started last, once everything it uses is constructed.
+  std::thread thread_;
+};
+
+#endif
@@ -0,0 +1,39 @@
+#include <benoni/http.h>
+
+#include <iostream>
+#include <memory_resource>
+
+using benoni::request_sync;
+using benoni::RequestOptionsBuilder;
+using benoni::Response;
+
+int main() {
+  std::string url{"https://postman-echo.com/get"};
+  std::cout << "sending request to: \"" << url << "\"" << std::endl;
+
+  std::pmr::monotonic_buffer_resource arena;
+  std::variant<std::string, Response> result = request_sync(
+      url, RequestOptionsBuilder{}.set_memory_resource(&arena).build());
+  if (std::holds_alternative<std::string>(result)) {
+    std::cerr << "error: [" << std::get<std::string>(result) << "]"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  const Response &response = std::get<Response>(result);
+  if (response.body.empty() ||
+      response.body.get_allocator().resource() != &arena) {
+    std::cerr << "response body was not allocated from the arena" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (response.headers.empty() ||
+      response.headers.get_allocator().resource() != &arena ||
+      response.headers.begin()->second.get_allocator().resource() != &arena) {
+    std::cerr << "response headers were not allocated from the arena"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,48 @@
+#include <benoni/http.h>
+
+#include <iostream>
+
+using benoni::request_sync;
+using benoni::RequestOptionsBuilder;
+using benoni::Response;
+
+int main() {
+  // No main loop is run here, request_sync() must not need one.
+  std::string url{"https://postman-echo.com/get"};
+  std::cout << "sending request to: \"" << url << "\"" << std::endl;
+
+  std::variant<std::string, Response> result =
+      request_sync(url, RequestOptionsBuilder{}.build());
+  if (std::holds_alternative<std::string>(result)) {
+    std::cerr << "error: [" << std::get<std::string>(result) << "]"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  Response response{std::get<Response>(result)};
+
+  if (response.status != 200) {
+    std::cerr << "response status: " << response.status << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  auto content_type = response.headers.find("Content-Type");
+  if (content_type == response.headers.end() ||
+      content_type->second != "application/json; charset=utf-8") {
+    std::cout << "unexpected content type in response headers: [" << std::endl;
+    for (const auto &[key, value] : response.headers) {
+      std::cout << "  \"" << key << "\": \"" << value << "\"," << std::endl;
+    }
+    std::cout << "]" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (response.body.find("\"user-agent\": \"Benoni/1.0\"") ==
+      std::string::npos) {
+    std::cerr << "user agent not found in response body: \"" << response.body
+              << "\"" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,65 @@
+#include <benoni/http.h>
+#include <benoni/replay.h>
+
+#include <cstdio>
+#include <iostream>
+
+using benoni::request_sync;
+using benoni::RequestOptionsBuilder;
+using benoni::Response;
+
+int main() {
+  std::string archive{"replay-test.benoni"};
+  std::remove(archive.c_str());
+
+  std::string url{"https://postman-echo.com/get?replay=1"};
+  std::cout << "recording request to: \"" << url << "\"" << std::endl;
+
+  if (auto error = benoni::start_recording(archive)) {
+    std::cerr << "start_recording error: [" << *error << "]" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::variant<std::string, Response> recorded =
+      request_sync(url, RequestOptionsBuilder{}.build());
+  benoni::stop_recording();
+
+  if (std::holds_alternative<std::string>(recorded)) {
+    std::cerr << "error: [" << std::get<std::string>(recorded) << "]"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (auto error = benoni::start_replay(archive)) {
+    std::cerr << "start_replay error: [" << *error << "]" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::variant<std::string, Response> replayed =
+      request_sync(url, RequestOptionsBuilder{}.build());
+  std::variant<std::string, Response> unmatched =
+      request_sync(url + "&unmatched=1", RequestOptionsBuilder{}.build());
+  benoni::stop_replay();
+  std::remove(archive.c_str());
+
+  if (std::holds_alternative<std::string>(replayed)) {
+    std::cerr << "replay error: [" << std::get<std::string>(replayed) << "]"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  const Response &recorded_response = std::get<Response>(recorded);
+  const Response &replayed_response = std::get<Response>(replayed);
+  if (replayed_response.status != recorded_response.status ||
+      replayed_response.body != recorded_response.body ||
+      replayed_response.headers != recorded_response.headers) {
+    std::cerr << "replayed response differs from the recorded one: \""
+              << replayed_response.body << "\"" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (!std::holds_alternative<std::string>(unmatched)) {
+    std::cerr << "unmatched request was not rejected" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
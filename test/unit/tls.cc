@@ -0,0 +1,76 @@
+#include <benoni/http.h>
+
+#include <iostream>
+#include <string>
+
+using benoni::request_sync;
+using benoni::RequestOptions;
+using benoni::RequestOptionsBuilder;
+using benoni::Response;
+using benoni::TlsOptionsBuilder;
+using benoni::TlsStats;
+
+namespace {
+
+// The system bundle on Debian and Ubuntu, given as a file so that
+// reload_tls_files() has something to read again.
+constexpr const char *kCaFile = "/etc/ssl/certs/ca-certificates.crt";
+
+auto options() -> RequestOptions {
+  return RequestOptionsBuilder{}
+      .set_tls(TlsOptionsBuilder{}.set_ca_file(kCaFile).build())
+      .build();
+}
+
+auto send(const std::string &url) -> bool {
+  std::variant<std::string, Response> result = request_sync(url, options());
+  if (std::holds_alternative<std::string>(result)) {
+    std::cerr << "error: [" << std::get<std::string>(result) << "]"
+              << std::endl;
+    return false;
+  }
+  if (std::get<Response>(result).status != 200) {
+    std::cerr << "response status: " << std::get<Response>(result).status
+              << std::endl;
+    return false;
+  }
+  return true;
+}
+
+} // namespace
+
+int main() {
+  std::string url{"https://postman-echo.com/get"};
+  std::cout << "sending requests to: \"" << url << "\"" << std::endl;
+
+  // Sequential requests with the same TLS options share one connection.
+  TlsStats before = benoni::tls_stats();
+  if (!send(url) || !send(url)) {
+    return EXIT_FAILURE;
+  }
+  TlsStats after = benoni::tls_stats();
+  if (after.handshakes - before.handshakes != 1 ||
+      after.reused_connections - before.reused_connections < 1) {
+    std::cerr << "two requests performed "
+              << after.handshakes - before.handshakes
+              << " handshakes and reused "
+              << after.reused_connections - before.reused_connections
+              << " connections" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Reloading the certificate files starts over with new connections.
+  benoni::reload_tls_files();
+  if (!send(url)) {
+    return EXIT_FAILURE;
+  }
+  TlsStats reloaded = benoni::tls_stats();
+  if (reloaded.handshakes - after.handshakes != 1) {
+    std::cerr << "request after reload_tls_files() performed "
+              << reloaded.handshakes - after.handshakes << " handshakes"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
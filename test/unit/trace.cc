@@ -0,0 +1,99 @@
+#include <benoni/concurrency.h>
+#include <benoni/http.h>
+#include <benoni/trace.h>
+
+#include <iostream>
+#include <optional>
+
+using benoni::AdaptiveConcurrencyOptionsBuilder;
+using benoni::request_sync;
+using benoni::RequestOptionsBuilder;
+using benoni::Response;
+
+namespace {
+
+// The request joins the trace of its `traceparent` header.
+auto test_traceparent() -> bool {
+  std::string url{"https://postman-echo.com/get"};
+  std::cout << "sending traced request to: \"" << url << "\"" << std::endl;
+
+  // The header name differs in case from `traceparent` on purpose.
+  std::string trace_id{"0af7651916cd43dd8448eb211c80319c"};
+  benoni::start_tracing();
+  std::variant<std::string, Response> result = request_sync(
+      url, RequestOptionsBuilder{}
+               .set_headers({{"Traceparent",
+                              "00-" + trace_id + "-b7ad6b7169203331-01"}})
+               .build());
+  benoni::stop_tracing();
+
+  if (std::holds_alternative<std::string>(result)) {
+    std::cerr << "error: [" << std::get<std::string>(result) << "]"
+              << std::endl;
+    return false;
+  }
+
+  // The request is sent as a child span of the same trace.
+  const Response &response = std::get<Response>(result);
+  if (response.body.find("\"traceparent\": \"00-" + trace_id + "-") ==
+      std::string::npos) {
+    std::cerr << "trace id not found in response body: \"" << response.body
+              << "\"" << std::endl;
+    return false;
+  }
+
+  std::string chrome_trace = benoni::chrome_trace();
+  for (const char *event : {"\"name\":\"request\",\"ph\":\"b\"",
+                            "\"name\":\"headers\",\"ph\":\"n\"",
+                            "\"name\":\"request\",\"ph\":\"e\""}) {
+    if (chrome_trace.find(event) == std::string::npos) {
+      std::cerr << "event " << event << " not found in trace: \""
+                << chrome_trace << "\"" << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+// A request that the concurrency limiter rejects is still traced.
+auto test_rejected() -> bool {
+  std::string url{"https://postman-echo.com/get"};
+  benoni::enable_adaptive_concurrency(AdaptiveConcurrencyOptionsBuilder{}
+                                          .set_limits(1, 1)
+                                          .set_max_queue(0)
+                                          .build());
+  benoni::start_tracing();
+  // Takes the only slot of the host. The main loop never runs, so the request
+  // stays in flight.
+  benoni::request(url, RequestOptionsBuilder{}.build(),
+                  [](std::variant<std::string, Response>) {});
+  std::optional<std::string> error;
+  benoni::request(url, RequestOptionsBuilder{}.build(),
+                  [&error](std::variant<std::string, Response> result) {
+                    if (std::holds_alternative<std::string>(result)) {
+                      error = std::get<std::string>(std::move(result));
+                    }
+                  });
+  benoni::stop_tracing();
+  benoni::disable_adaptive_concurrency();
+
+  if (!error.has_value()) {
+    std::cerr << "the limiter did not reject the request" << std::endl;
+    return false;
+  }
+  std::string chrome_trace = benoni::chrome_trace();
+  if (chrome_trace.find(
+          "\"name\":\"request\",\"ph\":\"e\",\"args\":{\"error\":true}") ==
+      std::string::npos) {
+    std::cerr << "rejected request not found in trace: \"" << chrome_trace
+              << "\"" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+} // namespace
+
+int main() {
+  return test_traceparent() && test_rejected() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,204 @@
+#include <benoni/websocket.h>
+
+#include <libsoup/soup.h>
+
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+
+using benoni::WebSocket;
+using benoni::WebSocketHandlers;
+using benoni::WebSocketOptionsBuilder;
+
+namespace {
+
+constexpr uint16_t kCloseCode = 4000;
+constexpr const char *kCloseReason = "bye";
+
+// Embedded NULs must survive the round trip.
+const std::string kText{"hello\0world", 11};
+const std::string kBinary{"\x00\x01\xfe\xff", 4};
+
+constexpr std::size_t kHighWaterMark = 64 * 1024;
+constexpr std::size_t kChunkSize = 16 * 1024;
+// Gives up on back pressure after this many bytes.
+constexpr std::size_t kMaxBulkBytes = 256 * 1024 * 1024;
+
+// Echoes every message back, and closes the connection with kCloseCode and
+// kCloseReason once it receives the text "close".
+auto server_message_callback(SoupWebsocketConnection *connection, gint type,
+                             GBytes *message, gpointer /* data */) -> void {
+  gsize size = 0;
+  auto bytes = static_cast<const char *>(g_bytes_get_data(message, &size));
+  if (type == SOUP_WEBSOCKET_DATA_TEXT &&
+      std::string{bytes != nullptr ? bytes : "", size} == "close") {
+    soup_websocket_connection_close(connection, kCloseCode, kCloseReason);
+    return;
+  }
+  soup_websocket_connection_send_message(
+      connection, static_cast<SoupWebsocketDataType>(type), message);
+}
+
+auto server_closed_callback(SoupWebsocketConnection *connection,
+                            gpointer /* data */) -> void {
+  g_object_unref(connection);
+}
+
+auto server_websocket_callback(SoupServer * /* server */,
+                               SoupWebsocketConnection *connection,
+                               const char * /* path */,
+                               SoupClientContext * /* client */,
+                               gpointer /* data */) -> void {
+  g_object_ref(connection);
+  g_signal_connect(connection, "message", G_CALLBACK(server_message_callback),
+                   nullptr);
+  g_signal_connect(connection, "closed", G_CALLBACK(server_closed_callback),
+                   nullptr);
+}
+
+// Runs on the default main context, like the client.
+class EchoServer {
+public:
+  EchoServer() : server_{soup_server_new(nullptr, nullptr)} {
+    soup_server_add_websocket_handler(server_, "/echo", nullptr, nullptr,
+                                      server_websocket_callback, nullptr,
+                                      nullptr);
+    GError *error = nullptr;
+    if (soup_server_listen_local(server_, 0, SOUP_SERVER_LISTEN_IPV4_ONLY,
+                                 &error) == FALSE) {
+      std::cerr << "could not listen: " << error->message << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+    GSList *uris = soup_server_get_uris(server_);
+    port_ = soup_uri_get_port(static_cast<SoupURI *>(uris->data));
+    g_slist_free_full(uris, reinterpret_cast<GDestroyNotify>(soup_uri_free));
+  }
+
+  ~EchoServer() { g_object_unref(server_); }
+
+  auto url() const -> std::string {
+    return "ws://127.0.0.1:" + std::to_string(port_) + "/echo";
+  }
+
+private:
+  SoupServer *server_;
+  guint port_ = 0;
+};
+
+struct State {
+  std::shared_ptr<WebSocket> web_socket;
+  bool echoed_text = false;
+  bool echoed_binary = false;
+  bool back_pressure = false;
+  bool drained = false;
+  std::size_t bulk_sent = 0;
+  std::optional<std::string> failure;
+  bool done = false;
+};
+
+auto fail(State &state, std::string failure) -> void {
+  if (!state.failure.has_value()) {
+    state.failure = std::move(failure);
+  }
+  if (state.web_socket != nullptr) {
+    state.web_socket->close(1011, {});
+  }
+}
+
+// Sends chunks without letting the main loop run, so that the echo server does
+// not read them, until the send buffer is full and more than the high water
+// mark is buffered.
+auto send_bulk(State &state) -> void {
+  std::string chunk(kChunkSize, 'x');
+  while (state.bulk_sent * kChunkSize < kMaxBulkBytes) {
+    ++state.bulk_sent;
+    if (!state.web_socket->send_binary(chunk)) {
+      state.back_pressure = true;
+      break;
+    }
+  }
+  if (!state.back_pressure) {
+    fail(state, "send_binary() never returned false");
+  } else if (state.web_socket->buffered_amount() <= kHighWaterMark) {
+    fail(state, "send_binary() returned false below the high water mark");
+  }
+}
+
+} // namespace
+
+int main() {
+  EchoServer server;
+  std::cout << "connecting to: \"" << server.url() << "\"" << std::endl;
+
+  State state;
+  benoni::websocket_connect(
+      server.url(),
+      WebSocketOptionsBuilder{}.set_high_water_mark(kHighWaterMark).build(),
+      WebSocketHandlers{
+          .on_open =
+              [&state](std::shared_ptr<WebSocket> web_socket) {
+                state.web_socket = std::move(web_socket);
+                if (!state.web_socket->send_text(kText) ||
+                    !state.web_socket->send_binary(kBinary)) {
+                  fail(state, "send failed below the high water mark");
+                }
+              },
+          .on_message =
+              [&state](std::string message) {
+                if (message != kText) {
+                  fail(state, "text was not echoed intact");
+                }
+                state.echoed_text = true;
+              },
+          .on_binary =
+              [&state](std::string data) {
+                // Echoes of the bulk chunks.
+                if (state.echoed_binary) {
+                  return;
+                }
+                state.echoed_binary = true;
+                if (data != kBinary) {
+                  fail(state, "binary data was not echoed intact");
+                  return;
+                }
+                send_bulk(state);
+              },
+          .on_drain =
+              [&state]() {
+                state.drained = true;
+                state.web_socket->send_text("close");
+              },
+          .on_close =
+              [&state](uint16_t code, std::string reason) {
+                if (code != kCloseCode || reason != kCloseReason) {
+                  fail(state, "closed with " + std::to_string(code) + " \"" +
+                                  reason + "\"");
+                }
+                state.web_socket.reset();
+                state.done = true;
+              },
+          .on_error =
+              [&state](std::string error) {
+                fail(state, "error: [" + error + "]");
+                state.done = state.web_socket == nullptr;
+              },
+      });
+
+  while (!state.done) {
+    g_main_context_iteration(nullptr, TRUE);
+  }
+
+  if (!state.failure.has_value()) {
+    if (!state.echoed_text || !state.echoed_binary) {
+      state.failure = "messages were not echoed";
+    } else if (!state.drained) {
+      state.failure = "on_drain was not called";
+    }
+  }
+  if (state.failure.has_value()) {
+    std::cerr << state.failure.value() << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}